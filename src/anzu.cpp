@@ -0,0 +1,88 @@
+#include "anzu.hpp"
+#include "compiler.hpp"
+#include "parser.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace anzu {
+namespace {
+
+// Makes panics throw panic_error on this thread for the duration of a call into the library
+class throwing_panics
+{
+    bool d_previous = std::exchange(throw_panics, true);
+
+public:
+    throwing_panics() = default;
+    throwing_panics(const throwing_panics&) = delete;
+    throwing_panics& operator=(const throwing_panics&) = delete;
+    ~throwing_panics() { throw_panics = d_previous; }
+};
+
+}
+
+auto compile_file(const std::filesystem::path& file, const native_registry& natives) -> bytecode_program
+{
+    const auto guard = throwing_panics{};
+    return compile(parse(file), natives);
+}
+
+auto compile_source(std::string_view source, const native_registry& natives) -> bytecode_program
+{
+    const auto guard = throwing_panics{};
+    return compile(parse(std::make_unique<std::string>(source)), natives);
+}
+
+auto find_function(const bytecode_program& program, std::string_view name) -> std::optional<std::size_t>
+{
+    const auto full_name = function_name{"__main__", type_struct{""}, std::string{name}}.to_string();
+    for (const auto& function : program.functions) {
+        if (function.name == full_name || std::ranges::find(function.merged_names, full_name) != function.merged_names.end()) {
+            return function.id;
+        }
+    }
+    return std::nullopt;
+}
+
+execution_context::execution_context(const bytecode_program& program)
+    : d_ctx{program.functions, program.natives, program.rom}
+{}
+
+auto execution_context::reset() -> void
+{
+    reset_context(d_ctx);
+}
+
+auto execution_context::set_args(std::span<const std::string_view> args) -> void
+{
+    d_ctx.args.clear();
+    for (const auto arg : args) {
+        d_ctx.args.emplace_back(arg.data(), arg.size());
+    }
+}
+
+auto execution_context::set_output(std::string* output) -> void
+{
+    d_ctx.output = output;
+}
+
+auto execution_context::run() -> void
+{
+    const auto guard = throwing_panics{};
+    run_program(d_ctx);
+}
+
+auto execution_context::call(
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::span<std::byte> result
+)
+    -> void
+{
+    const auto guard = throwing_panics{};
+    call_function(d_ctx, function_id, args, result);
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "bytecode.hpp"
+#include "native.hpp"
+#include "runtime.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// The public interface for embedding Anzu in a C++ program. A program is compiled
+// once and can then be run any number of times from independent contexts.
+//
+// Compile errors and runtime errors, including those raised by workers the program
+// spawned, are thrown as panic_error rather than ending the host process. A context
+// that threw can be run again, since every run starts by resetting it.
+namespace anzu {
+
+// Functions in the registry can be called by name from the program
+auto compile_file(const std::filesystem::path& file, const native_registry& natives = {}) -> bytecode_program;
+auto compile_source(std::string_view source, const native_registry& natives = {}) -> bytecode_program;
+
+// Returns the id of a function defined at the top level of the main module
+auto find_function(const bytecode_program& program, std::string_view name) -> std::optional<std::size_t>;
+
+// Owns the stack and arenas needed to run a program. Contexts do not share any state
+// so separate contexts can run the same program concurrently, but a single context
+// must only be used by one thread at a time. The program must outlive the context.
+class execution_context
+{
+    bytecode_context d_ctx;
+
+public:
+    explicit execution_context(const bytecode_program& program);
+
+    // Clears the state left by the previous run but keeps the stack and arenas
+    // allocated. This is done automatically at the start of every run and call.
+    auto reset() -> void;
+
+    // Sets the values returned by @args. The strings must outlive any runs that use them.
+    auto set_args(std::span<const std::string_view> args) -> void;
+
+    // Captures the output of print statements into the given string rather than writing
+    // to stdout. Passing nullptr restores the default.
+    auto set_output(std::string* output) -> void;
+
+    // Runs the main function of the program
+    auto run() -> void;
+
+    // Calls a function directly with the given arguments. Arguments and return values
+    // are passed in the same representation as the VM uses, so a span of chars is
+    // a pointer followed by a u64 size.
+    auto call(std::size_t function_id, std::span<const std::byte> args, std::span<std::byte> result) -> void;
+
+    // Converts the arguments and return value the same way as natives do, with void for
+    // functions that return null
+    template <typename Ret, typename... Args>
+    auto call(std::size_t function_id, const Args&... args) -> Ret
+    {
+        auto buffer = std::array<std::byte, (native_size<Args>() + ... + 0)>{};
+        auto offset = std::size_t{0};
+        ((write_native(args, buffer.data() + offset), offset += native_size<Args>()), ...);
+
+        if constexpr (std::is_void_v<Ret>) {
+            auto ret = std::byte{0}; // functions returning null return a single byte
+            call(function_id, buffer, std::span{&ret, 1});
+        } else {
+            auto ret = std::array<std::byte, native_size<Ret>()>{};
+            call(function_id, buffer, ret);
+            return read_native<Ret>(ret.data());
+        }
+    }
+};
+
+}
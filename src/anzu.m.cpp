@@ -1,3 +1,4 @@
+#include "anzu.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "compiler.hpp"
@@ -6,27 +7,116 @@
 #include "utility/common.hpp"
 #include "utility/memory.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <iostream>
 #include <string>
+#include <string_view>
 #include <map>
+#include <mutex>
 #include <set>
+#include <span>
 #include <filesystem>
 #include <print>
+#include <ranges>
+#include <thread>
+#include <vector>
 
 void print_usage()
 {
-    std::print("usage: anzu.exe <program_file> <option>\n\n");
+    std::print("usage: anzu.exe <program_file> <option> [args...]\n\n");
     std::print("The Anzu Programming Language\n\n");
     std::print("options:\n");
     std::print("    lex      - runs the lexer and prints the tokens for a single file\n");
     std::print("    parse    - runs the parser and prints the AST for a single file\n");
     std::print("    com      - runs the compiler and prints the bytecode\n");
     std::print("    debug    - runs the program and prints each op code executed\n");
-    std::print("    run      - runs the program\n");
+    std::print("    run      - runs the program, any further args are available via @args\n");
+    std::print("    run-many - runs the program once per further arg on a thread pool\n");
+    std::print("    serve    - runs the program once per line read from stdin\n");
+}
+
+// Compiles once and runs the program for each input concurrently, with the input being
+// the only value in @args. Output is buffered per input and printed in input order as
+// soon as every earlier input has finished. A run that panics reports the error as its
+// output and the remaining inputs still run. Returns false if any run panicked.
+auto run_many(const anzu::bytecode_program& program, std::span<const std::string_view> inputs) -> bool
+{
+    auto outputs = std::vector<std::string>(inputs.size());
+    auto done = std::vector<bool>(inputs.size());
+    auto printed = std::size_t{0};
+    auto lock = std::mutex{};
+    auto next = std::atomic<std::size_t>{0};
+    auto failed = std::atomic<bool>{false};
+
+    const auto finish = [&](std::size_t index) {
+        const auto guard = std::scoped_lock{lock};
+        done[index] = true;
+        for (; printed < inputs.size() && done[printed]; ++printed) {
+            std::print("-> {}\n{}", inputs[printed], outputs[printed]);
+            outputs[printed] = {};
+        }
+        std::fflush(stdout);
+    };
+
+    const auto num_threads = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), inputs.size());
+    auto pool = std::vector<std::jthread>{};
+    for (std::size_t i = 0; i != num_threads; ++i) {
+        pool.emplace_back([&] {
+            auto ctx = anzu::execution_context{program};
+            for (auto index = next++; index < inputs.size(); index = next++) {
+                ctx.set_args(inputs.subspan(index, 1));
+                ctx.set_output(&outputs[index]);
+                try {
+                    ctx.run();
+                } catch (const anzu::panic_error& error) {
+                    outputs[index] += std::format("panic: {}\n", error.what());
+                    failed = true;
+                }
+                finish(index);
+            }
+        });
+    }
+    pool.clear(); // joins the threads
+    return !failed;
+}
+
+// Keeps the compiled program and a single context warm, running the program once per
+// line read from stdin with the line being the only value in @args. Output is flushed
+// after every request and latency percentiles are printed once stdin is closed.
+auto serve(const anzu::bytecode_program& program) -> void
+{
+    auto ctx = anzu::bytecode_context{program.functions, program.natives, program.rom};
+    auto latencies = std::vector<double>{};
+
+    for (auto line = std::string{}; std::getline(std::cin, line);) {
+        if (line.ends_with('\r')) line.pop_back();
+        if (line.empty()) continue;
+
+        ctx.args.assign(1, std::span<const char>{line});
+        const auto start = std::chrono::steady_clock::now();
+        anzu::run_program(ctx);
+        const auto duration = std::chrono::steady_clock::now() - start;
+        latencies.push_back(std::chrono::duration<double, std::micro>(duration).count());
+        std::fflush(stdout);
+    }
+
+    if (latencies.empty()) return;
+    std::ranges::sort(latencies);
+    const auto percentile = [&](double p) {
+        return latencies[static_cast<std::size_t>(p / 100.0 * (latencies.size() - 1))];
+    };
+    std::print("\n-> Served {} requests\n", latencies.size());
+    std::print("   p50={:.2f}us p90={:.2f}us p99={:.2f}us max={:.2f}us\n",
+               percentile(50), percentile(90), percentile(99), latencies.back());
 }
 
 auto main(const int argc, const char* argv[]) -> int
 {
-    if (argc != 3) {
+    if (argc < 3) {
         print_usage();
         return 1;
     }
@@ -35,6 +125,7 @@ auto main(const int argc, const char* argv[]) -> int
     const auto file = std::filesystem::canonical(argv[1]);
     const auto root = file.parent_path();
     const auto mode = std::string{argv[2]};
+    const auto args = std::vector<std::string_view>(argv + 3, argv + argc);
 
     if (mode == "lex") {
         std::print("Lexing file '{}'\n", file.string());
@@ -61,12 +152,24 @@ auto main(const int argc, const char* argv[]) -> int
     }
 
     std::print("-> Running\n\n");
+    if (mode == "run-many") {
+        return run_many(program, args) ? 0 : 1;
+    }
+    else if (mode == "serve") {
+        serve(program);
+        return 0;
+    }
+
+    auto ctx = anzu::bytecode_context{program.functions, program.natives, program.rom};
+    for (const auto arg : args) {
+        ctx.args.emplace_back(arg.data(), arg.size());
+    }
     if (mode == "run") {
-        anzu::run_program(program);
+        anzu::run_program(ctx);
         return 0;
     }
     else if (mode == "debug") {
-        anzu::run_program_debug(program);
+        anzu::run_program_debug(ctx);
         return 0;
     }
 
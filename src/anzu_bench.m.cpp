@@ -0,0 +1,70 @@
+#include "anzu.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <print>
+#include <string>
+
+// Measures the per-run latency of running a small script many times back to back,
+// comparing a fresh context for every run with a single context that gets reset. A program
+// file can be given after the run count to time that instead of the built in script.
+namespace {
+
+constexpr auto script = R"(
+fn collatz(n: u64) -> u64
+{
+    var steps := 0u;
+    var x := n;
+    while x != 1u {
+        if x % 2u == 0u {
+            x = x / 2u;
+        } else {
+            x = 3u * x + 1u;
+        }
+        steps = steps + 1u;
+    }
+    return steps;
+}
+
+arena a;
+var lengths := new(a, 64u) 0u;
+var i := 0u;
+while i < @len(lengths) {
+    lengths[i] = collatz(i + 1u);
+    i = i + 1u;
+}
+)";
+
+template <typename Callable>
+auto time_runs(std::size_t runs, Callable&& callable) -> double
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != runs; ++i) {
+        callable();
+    }
+    const auto duration = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(duration).count() / runs;
+}
+
+}
+
+auto main(const int argc, const char* argv[]) -> int
+{
+    const auto runs = argc > 1 ? std::size_t{std::stoull(argv[1])} : std::size_t{10000};
+    const auto program = argc > 2 ? anzu::compile_file(argv[2]) : anzu::compile_source(script);
+
+    // Fresh contexts allocate a new stack and arenas each time, so run fewer of them
+    const auto fresh_runs = std::max(runs / 100, std::size_t{1});
+    const auto fresh = time_runs(fresh_runs, [&] {
+        auto ctx = anzu::execution_context{program};
+        ctx.run();
+    });
+
+    auto ctx = anzu::execution_context{program};
+    const auto reused = time_runs(runs, [&] { ctx.run(); });
+
+    std::print("fresh context: {:>10.2f} us/run ({} runs)\n", fresh, fresh_runs);
+    std::print("reset context: {:>10.2f} us/run ({} runs)\n", reused, runs);
+    return 0;
+}
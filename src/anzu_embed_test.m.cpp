@@ -0,0 +1,174 @@
+#include "anzu.hpp"
+
+#include <array>
+#include <cstdint>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Embeds the runtime in a host program, registering natives and calling functions from the
+// host, and checks the results and that errors in the program are reported to the host.
+// Returns non-zero if anything is wrong.
+namespace {
+
+constexpr auto script = R"(
+fn add_all(values: i64 const[]) -> i64
+{
+    return native_sum(values);
+}
+
+fn record_each(values: u64[]) -> null
+{
+    for value in values {
+        native_record(value);
+    }
+}
+
+fn text_length(text: char const[]) -> u64
+{
+    return native_length(text);
+}
+
+{
+    let values := [1, 2, 3, 4];
+    print("{}\n", add_all(values[]));
+}
+)";
+
+auto recorded = std::uint64_t{0};
+
+auto native_sum(std::span<const std::int64_t> values) -> std::int64_t
+{
+    auto sum = std::int64_t{0};
+    for (const auto value : values) sum += value;
+    return sum;
+}
+
+auto native_record(std::uint64_t value) -> void
+{
+    recorded += value;
+}
+
+auto native_length(std::span<const char> text) -> std::uint64_t
+{
+    return text.size();
+}
+
+auto failures = 0;
+
+constexpr auto failing_script = R"(
+fn fail_if(flag: bool) -> i64
+{
+    assert !flag;
+    return 1;
+}
+
+fn failing_worker() -> null
+{
+    assert false;
+}
+
+{
+    let args := @args();
+    if @len(args) == 1u {
+        fail_if(true);
+    }
+    if @len(args) == 2u {
+        @spawn(failing_worker);
+    }
+    print("ok\n");
+}
+)";
+
+// Runs the callable and checks that it throws a panic_error mentioning the given text
+template <typename Callable>
+auto check_panics(const char* what, const std::string& expected, Callable&& callable) -> void
+{
+    try {
+        callable();
+    } catch (const anzu::panic_error& error) {
+        if (!std::string_view{error.what()}.contains(expected)) {
+            std::print("FAILED: {}: got error '{}', expected '{}'\n", what, error.what(), expected);
+            ++failures;
+        }
+        return;
+    }
+    std::print("FAILED: {}: did not throw\n", what);
+    ++failures;
+}
+
+template <typename T>
+auto check(const char* what, const T& actual, const T& expected) -> void
+{
+    if (actual != expected) {
+        std::print("FAILED: {}: got {}, expected {}\n", what, actual, expected);
+        ++failures;
+    }
+}
+
+}
+
+auto main() -> int
+{
+    auto natives = anzu::native_registry{};
+    natives.add<native_sum>("native_sum");
+    natives.add<native_record>("native_record");
+    natives.add<native_length>("native_length");
+    const auto program = anzu::compile_source(script, natives);
+
+    auto output = std::string{};
+    auto ctx = anzu::execution_context{program};
+    ctx.set_output(&output);
+    ctx.run();
+    check("output of run", output, std::string{"10\n"});
+
+    const auto add_all = anzu::find_function(program, "add_all");
+    const auto record_each = anzu::find_function(program, "record_each");
+    const auto text_length = anzu::find_function(program, "text_length");
+    if (!add_all || !record_each || !text_length) {
+        std::print("FAILED: functions not found\n");
+        return 1;
+    }
+
+    const auto values = std::array<std::int64_t, 3>{5, -2, 40};
+    check("span argument", ctx.call<std::int64_t>(*add_all, std::span<const std::int64_t>{values}), std::int64_t{43});
+
+    auto to_record = std::array<std::uint64_t, 3>{1, 2, 3};
+    ctx.call<void>(*record_each, std::span<std::uint64_t>{to_record});
+    check("void native and void call", recorded, std::uint64_t{6});
+
+    const auto text = std::string_view{"hello"};
+    check("char span", ctx.call<std::uint64_t>(*text_length, std::span<const char>{text}), std::uint64_t{5});
+
+    // Errors are reported to the host, which can carry on using the program and context
+    check_panics("compile error", "cannot convert", [] {
+        anzu::compile_source("let x := 300u8;");
+    });
+    const auto failing = anzu::compile_source(failing_script);
+    auto failing_ctx = anzu::execution_context{failing};
+    auto failing_output = std::string{};
+    failing_ctx.set_output(&failing_output);
+
+    const auto one_arg = std::array<std::string_view, 1>{"a"};
+    failing_ctx.set_args(one_arg);
+    check_panics("runtime error", "assertion failed", [&] { failing_ctx.run(); });
+
+    const auto two_args = std::array<std::string_view, 2>{"a", "b"};
+    failing_ctx.set_args(two_args);
+    check_panics("worker error", "assertion failed", [&] { failing_ctx.run(); });
+
+    const auto fail_if = anzu::find_function(failing, "fail_if");
+    check_panics("call error", "assertion failed", [&] { failing_ctx.call<std::int64_t>(*fail_if, true); });
+    check("call after an error", failing_ctx.call<std::int64_t>(*fail_if, false), std::int64_t{1});
+
+    failing_output.clear();
+    failing_ctx.set_args({});
+    failing_ctx.run();
+    check("run after an error", failing_output, std::string{"ok\n"});
+
+    if (failures == 0) {
+        std::print("all embedding checks passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -27,15 +27,33 @@ auto print_node(const node_expr& root, int indent) -> void
 {
     const auto spaces = std::string(4 * indent, ' ');
     std::visit(overloaded {
+        [&](const node_literal_i8_expr& node) {
+            std::print("{}Literal (i8): {}\n", spaces, node.value);
+        },
+        [&](const node_literal_i16_expr& node) {
+            std::print("{}Literal (i16): {}\n", spaces, node.value);
+        },
         [&](const node_literal_i32_expr& node) {
             std::print("{}Literal (i32): {}\n", spaces, node.value);
         },
         [&](const node_literal_i64_expr& node) {
             std::print("{}Literal (i64): {}\n", spaces, node.value);
         },
+        [&](const node_literal_u8_expr& node) {
+            std::print("{}Literal (u8): {}\n", spaces, node.value);
+        },
+        [&](const node_literal_u16_expr& node) {
+            std::print("{}Literal (u16): {}\n", spaces, node.value);
+        },
+        [&](const node_literal_u32_expr& node) {
+            std::print("{}Literal (u32): {}\n", spaces, node.value);
+        },
         [&](const node_literal_u64_expr& node) {
             std::print("{}Literal (u64): {}\n", spaces, node.value);
         },
+        [&](const node_literal_f32_expr& node) {
+            std::print("{}Literal (f32): {}\n", spaces, node.value);
+        },
         [&](const node_literal_f64_expr& node) {
             std::print("{}Literal (f64): {}\n", spaces, node.value);
         },
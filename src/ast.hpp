@@ -19,6 +19,18 @@ struct name_pack
     std::variant<std::string, std::vector<name_pack>> names;
 };
 
+struct node_literal_i8_expr
+{
+    std::int8_t value;
+    anzu::token token;
+};
+
+struct node_literal_i16_expr
+{
+    std::int16_t value;
+    anzu::token  token;
+};
+
 struct node_literal_i32_expr
 {
     std::int32_t value;
@@ -31,12 +43,36 @@ struct node_literal_i64_expr
     anzu::token  token;
 };
 
+struct node_literal_u8_expr
+{
+    std::uint8_t value;
+    anzu::token  token;
+};
+
+struct node_literal_u16_expr
+{
+    std::uint16_t value;
+    anzu::token   token;
+};
+
+struct node_literal_u32_expr
+{
+    std::uint32_t value;
+    anzu::token   token;
+};
+
 struct node_literal_u64_expr
 {
     std::uint64_t value;
     anzu::token   token;
 };
 
+struct node_literal_f32_expr
+{
+    float       value;
+    anzu::token token;
+};
+
 struct node_literal_f64_expr
 {
     double      value;
@@ -209,9 +245,15 @@ struct node_as_expr
 };
 
 struct node_expr : std::variant<
+    node_literal_i8_expr,
+    node_literal_i16_expr,
     node_literal_i32_expr,
     node_literal_i64_expr,
+    node_literal_u8_expr,
+    node_literal_u16_expr,
+    node_literal_u32_expr,
     node_literal_u64_expr,
+    node_literal_f32_expr,
     node_literal_f64_expr,
     node_literal_char_expr,
     node_literal_bool_expr,
@@ -1,5 +1,8 @@
 #include "bytecode.hpp"
+#include "utility/common.hpp"
+#include "utility/memory.hpp"
 
+#include <limits>
 #include <print>
 #include <cstddef>
 #include <cstring>
@@ -17,6 +20,42 @@ auto read_at(const std::byte** ptr) -> T
     return ret;
 }
 
+// Ops whose std::uint64_t operands are values rather than sizes, offsets or ids, so they
+// are left at full width by encode_operands
+auto has_immediate_operand(op op_code) -> bool
+{
+    switch (op_code) {
+        case op::push_i64:
+        case op::push_u64:
+        case op::push_f64:
+        case op::i64_add_imm:
+        case op::i64_sub_imm:
+        case op::i64_mul_imm:
+        case op::i64_div_imm:
+        case op::i64_mod_imm:
+        case op::i64_eq_imm:
+        case op::i64_ne_imm:
+        case op::i64_lt_imm:
+        case op::i64_le_imm:
+        case op::i64_gt_imm:
+        case op::i64_ge_imm:
+        case op::u64_add_imm:
+        case op::u64_sub_imm:
+        case op::u64_mul_imm:
+        case op::u64_div_imm:
+        case op::u64_mod_imm:
+        case op::u64_eq_imm:
+        case op::u64_ne_imm:
+        case op::u64_lt_imm:
+        case op::u64_le_imm:
+        case op::u64_gt_imm:
+        case op::u64_ge_imm:
+            return true;
+        default:
+            return false;
+    }
+}
+
 }
 
 auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr) -> const std::byte*
@@ -27,6 +66,14 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
         case op::end_program: {
             std::print("END_PROGRAM\n");
         } break;
+        case op::push_i8: {
+            const auto value = read_at<std::int8_t>(&ptr);
+            std::print("PUSH_I8: {}\n", value);
+        } break;
+        case op::push_i16: {
+            const auto value = read_at<std::int16_t>(&ptr);
+            std::print("PUSH_I16: {}\n", value);
+        } break;
         case op::push_i32: {
             const auto value = read_at<std::int32_t>(&ptr);
             std::print("PUSH_I32: {}\n", value);
@@ -35,10 +82,26 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
             const auto value = read_at<std::int64_t>(&ptr);
             std::print("PUSH_I64: {}\n", value);
         } break;
+        case op::push_u8: {
+            const auto value = read_at<std::uint8_t>(&ptr);
+            std::print("PUSH_U8: {}\n", value);
+        } break;
+        case op::push_u16: {
+            const auto value = read_at<std::uint16_t>(&ptr);
+            std::print("PUSH_U16: {}\n", value);
+        } break;
+        case op::push_u32: {
+            const auto value = read_at<std::uint32_t>(&ptr);
+            std::print("PUSH_U32: {}\n", value);
+        } break;
         case op::push_u64: {
             const auto value = read_at<std::uint64_t>(&ptr);
             std::print("PUSH_U64: {}\n", value);
         } break;
+        case op::push_f32: {
+            const auto value = read_at<float>(&ptr);
+            std::print("PUSH_F32: {}\n", value);
+        } break;
         case op::push_f64: {
             const auto value = read_at<double>(&ptr);
             std::print("PUSH_F64: {}\n", value);
@@ -58,47 +121,88 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
             std::print("PUSH_NULLPTR\n");
         } break;
         case op::push_string_literal: {
-            const auto index = read_at<std::uint64_t>(&ptr);
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto index = read_at<bytecode_operand>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             const auto data = &rom[index];
             const auto m = std::string_view(data, size);
             std::print("PUSH_STRING_LITERAL: '{}'\n", m);
         } break;
+        case op::push_rom: {
+            const auto index = read_at<bytecode_operand>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_ROM: index={} size={}\n", index, size);
+        } break;
+        case op::push_ptr_rom: {
+            const auto index = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_PTR_ROM: index={}\n", index);
+        } break;
         case op::push_ptr_global: {
-            const auto offset = read_at<std::uint64_t>(&ptr);
+            const auto offset = read_at<bytecode_operand>(&ptr);
             std::print("PUSH_PTR_GLOBAL: {}\n", offset);
         } break;
         case op::push_ptr_local: {
-            const auto offset = read_at<std::uint64_t>(&ptr);
+            const auto offset = read_at<bytecode_operand>(&ptr);
             std::print("PUSH_PTR_LOCAL: base_ptr + {}\n", offset);
         } break;
         case op::push_val_global: {
-            const auto offset = read_at<std::uint64_t>(&ptr);
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("PUSH_VAL_GLOBAL: {}, size={}\n", offset, size);
         } break;
         case op::push_val_local: {
-            const auto offset = read_at<std::uint64_t>(&ptr);
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("PUSH_VAL_LOCAL: base_ptr + {}, size={}\n", offset, size);
         } break;
+        case op::push_val_global_1: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_GLOBAL_1: {}\n", offset);
+        } break;
+        case op::push_val_global_4: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_GLOBAL_4: {}\n", offset);
+        } break;
+        case op::push_val_global_8: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_GLOBAL_8: {}\n", offset);
+        } break;
+        case op::push_val_global_16: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_GLOBAL_16: {}\n", offset);
+        } break;
+        case op::push_val_local_1: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_LOCAL_1: base_ptr + {}\n", offset);
+        } break;
+        case op::push_val_local_4: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_LOCAL_4: base_ptr + {}\n", offset);
+        } break;
+        case op::push_val_local_8: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_LOCAL_8: base_ptr + {}\n", offset);
+        } break;
+        case op::push_val_local_16: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_VAL_LOCAL_16: base_ptr + {}\n", offset);
+        } break;
         case op::push_function_ptr: {
-            const auto id = read_at<std::uint64_t>(&ptr);
+            const auto id = read_at<bytecode_operand>(&ptr);
             std::print("PUSH_FUNCTION_PTR: id={}\n", id);
         } break;
         case op::nth_element_ptr: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("NTH_ELEMENT_PTR: size={}\n", size);
         } break;
         case op::nth_element_val: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("NTH_ELEMENT_VAL: size={}\n", size);
         } break;
         case op::span_ptr_to_len: {
             std::print("SPAN_PTR_TO_LEN\n");
         } break;
         case op::push_subspan: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("PUSH_SUBSPAN: size={}\n", size);
         } break;
         case op::arena_new: {
@@ -108,72 +212,116 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
             std::print("ARENA_DELETE\n");
         } break;
         case op::arena_alloc: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("ARENA_ALLOC: size={}\n", size);
         } break;
         case op::arena_alloc_array: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("ARENA_ALLOC_ARRAY: size={}\n", size);
         } break;
+        case op::arena_alloc_soa: {
+            const auto num_fields = read_at<bytecode_operand>(&ptr);
+            std::print("ARENA_ALLOC_SOA: num_fields={}\n", num_fields);
+        } break;
         case op::arena_realloc_array: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("ARENA_REALLOC_ARRAY: size={}\n", size);
         } break;
         case op::arena_size: {
             std::print("ARENA_SIZE\n");
         } break;
         case op::load: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("LOAD: {}\n", size);
         } break;
         case op::save: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("SAVE: {}\n", size);
         } break;
+        case op::load_1: {
+            std::print("LOAD_1\n");
+        } break;
+        case op::load_4: {
+            std::print("LOAD_4\n");
+        } break;
+        case op::load_8: {
+            std::print("LOAD_8\n");
+        } break;
+        case op::load_16: {
+            std::print("LOAD_16\n");
+        } break;
+        case op::save_1: {
+            std::print("SAVE_1\n");
+        } break;
+        case op::save_4: {
+            std::print("SAVE_4\n");
+        } break;
+        case op::save_8: {
+            std::print("SAVE_8\n");
+        } break;
+        case op::save_16: {
+            std::print("SAVE_16\n");
+        } break;
         case op::push: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("PUSH: {}\n", size);
         } break;
+        case op::push_zero: {
+            const auto size = read_at<bytecode_operand>(&ptr);
+            std::print("PUSH_ZERO: {}\n", size);
+        } break;
         case op::pop: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("POP: {}\n", size);
         } break;
         case op::memcpy: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("MEMCPY: {}\n", size);
         } break;
         case op::memcmp: {
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             std::print("MEMCMP: {}\n", size);
         } break;
         case op::jump: {
-            const auto jump = read_at<std::uint64_t>(&ptr);
+            const auto jump = read_at<bytecode_operand>(&ptr);
             std::print("JUMP: jump={}\n", jump);
         } break;
         case op::jump_if_true: {
-            const auto jump = read_at<std::uint64_t>(&ptr);
+            const auto jump = read_at<bytecode_operand>(&ptr);
             std::print("JUMP_IF_TRUE: jump={}\n", jump);
         } break;
         case op::jump_if_false: {
-            const auto jump = read_at<std::uint64_t>(&ptr);
+            const auto jump = read_at<bytecode_operand>(&ptr);
             std::print("JUMP_IF_FALSE: jump={}\n", jump);
         } break;
         case op::ret: {
-            const auto type_size = read_at<std::uint64_t>(&ptr);
+            const auto type_size = read_at<bytecode_operand>(&ptr);
             std::print("RETURN: type_size={}\n", type_size);
         } break;
+        case op::ret_local: {
+            const auto offset = read_at<bytecode_operand>(&ptr);
+            const auto type_size = read_at<bytecode_operand>(&ptr);
+            std::print("RETURN_LOCAL: base_ptr + {}, type_size={}\n", offset, type_size);
+        } break;
         case op::call_static: {
-            const auto id = read_at<std::uint64_t>(&ptr);
-            const auto args_size = read_at<std::uint64_t>(&ptr);
+            const auto id = read_at<bytecode_operand>(&ptr);
+            const auto args_size = read_at<bytecode_operand>(&ptr);
             std::print("CALL_PTR: id={} args_size={}\n", id, args_size);
         } break;
         case op::call_ptr: {
-            const auto args_size = read_at<std::uint64_t>(&ptr);
-            std::print("CALL_PTR: args_size={}\n", args_size);
+            const auto args_size = read_at<bytecode_operand>(&ptr);
+            const auto return_size = read_at<bytecode_operand>(&ptr);
+            std::print("CALL_PTR: args_size={} return_size={}\n", args_size, return_size);
+        } break;
+        case op::call_native: {
+            const auto id = read_at<bytecode_operand>(&ptr);
+            const auto args_size = read_at<bytecode_operand>(&ptr);
+            const auto return_size = read_at<bytecode_operand>(&ptr);
+            std::print("CALL_NATIVE: id={} args_size={} return_size={}\n", id, args_size, return_size);
         } break;
         case op::assert: {
-            const auto index = read_at<std::uint64_t>(&ptr);
-            const auto size = read_at<std::uint64_t>(&ptr);
+            const auto index = read_at<bytecode_operand>(&ptr);
+            const auto size = read_at<bytecode_operand>(&ptr);
             const auto data = &rom[index];
             std::print("ASSERT: msg={}\n", std::string_view{data, size});
         } break;
@@ -181,6 +329,42 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
         case op::read_file: {
             std::print("READ_FILE\n");
         } break;
+
+        case op::channel_new: {
+            const auto size = read_at<bytecode_operand>(&ptr);
+            std::print("CHANNEL_NEW: size={}\n", size);
+        } break;
+        case op::channel_send: {
+            const auto size = read_at<bytecode_operand>(&ptr);
+            std::print("CHANNEL_SEND: size={}\n", size);
+        } break;
+        case op::channel_recv: {
+            const auto size = read_at<bytecode_operand>(&ptr);
+            std::print("CHANNEL_RECV: size={}\n", size);
+        } break;
+        case op::spawn: {
+            const auto id = read_at<bytecode_operand>(&ptr);
+            const auto args_size = read_at<bytecode_operand>(&ptr);
+            std::print("SPAWN: id={} args_size={}\n", id, args_size);
+        } break;
+        case op::join: {
+            std::print("JOIN\n");
+        } break;
+        case op::push_args: {
+            std::print("PUSH_ARGS\n");
+        } break;
+        case op::atomic_load: {
+            std::print("ATOMIC_LOAD\n");
+        } break;
+        case op::atomic_store: {
+            std::print("ATOMIC_STORE\n");
+        } break;
+        case op::atomic_add: {
+            std::print("ATOMIC_ADD\n");
+        } break;
+        case op::atomic_cas: {
+            std::print("ATOMIC_CAS\n");
+        } break;
         
         case op::null_to_i64: { std::print("NULL_TO_I64\n"); } break;
         case op::bool_to_i64: { std::print("BOOL_TO_I64\n"); } break;
@@ -195,6 +379,20 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
         case op::i32_to_u64: { std::print("I32_TO_U64\n"); } break;
         case op::i64_to_u64: { std::print("I64_TO_U64\n"); } break;
         case op::f64_to_u64: { std::print("F64_TO_U64\n"); } break;
+
+        case op::i8_to_i64:  { std::print("I8_TO_I64\n"); } break;
+        case op::i16_to_i64: { std::print("I16_TO_I64\n"); } break;
+        case op::u8_to_u64:  { std::print("U8_TO_U64\n"); } break;
+        case op::u16_to_u64: { std::print("U16_TO_U64\n"); } break;
+        case op::u32_to_u64: { std::print("U32_TO_U64\n"); } break;
+        case op::f32_to_f64: { std::print("F32_TO_F64\n"); } break;
+        case op::i64_to_i8:  { std::print("I64_TO_I8\n"); } break;
+        case op::i64_to_i16: { std::print("I64_TO_I16\n"); } break;
+        case op::u64_to_u8:  { std::print("U64_TO_U8\n"); } break;
+        case op::u64_to_u16: { std::print("U64_TO_U16\n"); } break;
+        case op::u64_to_u32: { std::print("U64_TO_U32\n"); } break;
+        case op::f64_to_f32: { std::print("F64_TO_F32\n"); } break;
+        case op::i64_to_i32: { std::print("I64_TO_I32\n"); } break;
         
         case op::char_eq: { std::print("CHAR_EQ\n"); } break;
         case op::char_ne: { std::print("CHAR_NE\n"); } break;
@@ -231,6 +429,94 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
         case op::u64_le:  { std::print("U64_LE\n"); } break;
         case op::u64_gt:  { std::print("U64_GT\n"); } break;
         case op::u64_ge:  { std::print("U64_GE\n"); } break;
+        case op::i64_add_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_ADD_IMM: {}\n", value);
+        } break;
+        case op::i64_sub_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_SUB_IMM: {}\n", value);
+        } break;
+        case op::i64_mul_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_MUL_IMM: {}\n", value);
+        } break;
+        case op::i64_div_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_DIV_IMM: {}\n", value);
+        } break;
+        case op::i64_mod_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_MOD_IMM: {}\n", value);
+        } break;
+        case op::i64_eq_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_EQ_IMM: {}\n", value);
+        } break;
+        case op::i64_ne_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_NE_IMM: {}\n", value);
+        } break;
+        case op::i64_lt_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_LT_IMM: {}\n", value);
+        } break;
+        case op::i64_le_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_LE_IMM: {}\n", value);
+        } break;
+        case op::i64_gt_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_GT_IMM: {}\n", value);
+        } break;
+        case op::i64_ge_imm: {
+            const auto value = read_at<std::int64_t>(&ptr);
+            std::print("I64_GE_IMM: {}\n", value);
+        } break;
+        case op::u64_add_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_ADD_IMM: {}\n", value);
+        } break;
+        case op::u64_sub_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_SUB_IMM: {}\n", value);
+        } break;
+        case op::u64_mul_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_MUL_IMM: {}\n", value);
+        } break;
+        case op::u64_div_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_DIV_IMM: {}\n", value);
+        } break;
+        case op::u64_mod_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_MOD_IMM: {}\n", value);
+        } break;
+        case op::u64_eq_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_EQ_IMM: {}\n", value);
+        } break;
+        case op::u64_ne_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_NE_IMM: {}\n", value);
+        } break;
+        case op::u64_lt_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_LT_IMM: {}\n", value);
+        } break;
+        case op::u64_le_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_LE_IMM: {}\n", value);
+        } break;
+        case op::u64_gt_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_GT_IMM: {}\n", value);
+        } break;
+        case op::u64_ge_imm: {
+            const auto value = read_at<std::uint64_t>(&ptr);
+            std::print("U64_GE_IMM: {}\n", value);
+        } break;
         case op::f64_add: { std::print("F64_ADD\n"); } break;
         case op::f64_sub: { std::print("F64_SUB\n"); } break;
         case op::f64_mul: { std::print("F64_MUL\n"); } break;
@@ -241,6 +527,44 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
         case op::f64_le:  { std::print("F64_LE\n"); } break;
         case op::f64_gt:  { std::print("F64_GT\n"); } break;
         case op::f64_ge:  { std::print("F64_GE\n"); } break;
+        case op::u64_and:      { std::print("U64_AND\n"); } break;
+        case op::u64_or:       { std::print("U64_OR\n"); } break;
+        case op::u64_xor:      { std::print("U64_XOR\n"); } break;
+        case op::u64_not:      { std::print("U64_NOT\n"); } break;
+        case op::u64_shl:      { std::print("U64_SHL\n"); } break;
+        case op::u64_shr:      { std::print("U64_SHR\n"); } break;
+        case op::i64_shr:      { std::print("I64_SHR\n"); } break;
+        case op::u64_popcount: { std::print("U64_POPCOUNT\n"); } break;
+        case op::u64_ctz:      { std::print("U64_CTZ\n"); } break;
+        case op::u64_clz:      { std::print("U64_CLZ\n"); } break;
+        case op::u64_rotl:     { std::print("U64_ROTL\n"); } break;
+        case op::bits_set:       { std::print("BITS_SET\n"); } break;
+        case op::bits_clear:     { std::print("BITS_CLEAR\n"); } break;
+        case op::bits_test:      { std::print("BITS_TEST\n"); } break;
+        case op::bits_count:     { std::print("BITS_COUNT\n"); } break;
+        case op::bits_find_next: { std::print("BITS_FIND_NEXT\n"); } break;
+        case op::bits_and:       { std::print("BITS_AND\n"); } break;
+        case op::bits_or:        { std::print("BITS_OR\n"); } break;
+        case op::bits_xor:       { std::print("BITS_XOR\n"); } break;
+        case op::f64_sqrt:  { std::print("F64_SQRT\n"); } break;
+        case op::f64_floor: { std::print("F64_FLOOR\n"); } break;
+        case op::f64_ceil:  { std::print("F64_CEIL\n"); } break;
+        case op::f64_round: { std::print("F64_ROUND\n"); } break;
+        case op::f64_exp:   { std::print("F64_EXP\n"); } break;
+        case op::f64_log:   { std::print("F64_LOG\n"); } break;
+        case op::f64_sin:   { std::print("F64_SIN\n"); } break;
+        case op::f64_cos:   { std::print("F64_COS\n"); } break;
+        case op::f64_tan:   { std::print("F64_TAN\n"); } break;
+        case op::f64_pow:   { std::print("F64_POW\n"); } break;
+        case op::f64_atan2: { std::print("F64_ATAN2\n"); } break;
+        case op::i64_min:   { std::print("I64_MIN\n"); } break;
+        case op::i64_max:   { std::print("I64_MAX\n"); } break;
+        case op::u64_min:   { std::print("U64_MIN\n"); } break;
+        case op::u64_max:   { std::print("U64_MAX\n"); } break;
+        case op::f64_min:   { std::print("F64_MIN\n"); } break;
+        case op::f64_max:   { std::print("F64_MAX\n"); } break;
+        case op::i64_abs:   { std::print("I64_ABS\n"); } break;
+        case op::f64_abs:   { std::print("F64_ABS\n"); } break;
         case op::bool_eq:  { std::print("BOOL_EQ\n"); } break;
         case op::bool_ne:  { std::print("BOOL_NE\n"); } break;
         case op::bool_not: { std::print("BOOL_NOT\n"); } break;
@@ -253,6 +577,7 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
         case op::print_i32: { std::print("PRINT_I32\n"); } break;
         case op::print_i64: { std::print("PRINT_I64\n"); } break;
         case op::print_u64: { std::print("PRINT_U64\n"); } break;
+        case op::print_f32: { std::print("PRINT_F32\n"); } break;
         case op::print_f64: { std::print("PRINT_F64\n"); } break;
         case op::print_char_span: { std::print("PRINT_STRING_LITERAL\n"); break;
         case op::print_ptr: { std::print("PRINT_PTR\n"); } break;
@@ -267,12 +592,118 @@ auto print_op(std::string_view rom, const std::byte* start, const std::byte* ptr
 
 auto linebreak() { std::print("==================================\n"); }
 
+auto operands_size(op op_code) -> std::size_t
+{
+    switch (op_code) {
+        case op::push_i8:
+        case op::push_u8:
+        case op::push_char:
+        case op::push_bool:
+            return sizeof(std::uint8_t);
+        case op::push_i16:
+        case op::push_u16:
+            return sizeof(std::uint16_t);
+        case op::push_i32:
+        case op::push_u32:
+        case op::push_f32:
+            return sizeof(std::uint32_t);
+        case op::push_i64:
+        case op::push_u64:
+        case op::push_f64:
+        case op::i64_add_imm:
+        case op::i64_sub_imm:
+        case op::i64_mul_imm:
+        case op::i64_div_imm:
+        case op::i64_mod_imm:
+        case op::i64_eq_imm:
+        case op::i64_ne_imm:
+        case op::i64_lt_imm:
+        case op::i64_le_imm:
+        case op::i64_gt_imm:
+        case op::i64_ge_imm:
+        case op::u64_add_imm:
+        case op::u64_sub_imm:
+        case op::u64_mul_imm:
+        case op::u64_div_imm:
+        case op::u64_mod_imm:
+        case op::u64_eq_imm:
+        case op::u64_ne_imm:
+        case op::u64_lt_imm:
+        case op::u64_le_imm:
+        case op::u64_gt_imm:
+        case op::u64_ge_imm:
+        case op::push_function_ptr:
+        case op::push_ptr_rom:
+        case op::push_ptr_global:
+        case op::push_ptr_local:
+        case op::push_val_global_1:
+        case op::push_val_global_4:
+        case op::push_val_global_8:
+        case op::push_val_global_16:
+        case op::push_val_local_1:
+        case op::push_val_local_4:
+        case op::push_val_local_8:
+        case op::push_val_local_16:
+        case op::nth_element_ptr:
+        case op::nth_element_val:
+        case op::push_subspan:
+        case op::arena_alloc:
+        case op::arena_alloc_array:
+        case op::arena_realloc_array:
+        case op::arena_alloc_soa:
+        case op::load:
+        case op::save:
+        case op::push:
+        case op::push_zero:
+        case op::pop:
+        case op::memcpy:
+        case op::memcmp:
+        case op::jump:
+        case op::jump_if_true:
+        case op::jump_if_false:
+        case op::ret:
+        case op::channel_new:
+        case op::channel_send:
+        case op::channel_recv:
+            return sizeof(std::uint64_t);
+        case op::push_string_literal:
+        case op::push_rom:
+        case op::push_val_global:
+        case op::push_val_local:
+        case op::ret_local:
+        case op::call_static:
+        case op::call_ptr:
+        case op::assert:
+        case op::spawn:
+            return 2 * sizeof(std::uint64_t);
+        case op::call_native:
+            return 3 * sizeof(std::uint64_t);
+        default:
+            return 0;
+    }
+}
+
 auto print_program(const bytecode_program& prog) -> void
 {
-    std::print("PROGRAM (num functions = {})\n", prog.functions.size());
+    auto num_folded = std::size_t{0};
+    auto bytes_saved = std::size_t{0};
+    auto code_size = std::size_t{0};
+    auto wide_size = std::size_t{0};
+    for (const auto& func : prog.functions) {
+        num_folded += func.merged_names.size();
+        bytes_saved += func.merged_names.size() * func.code.size();
+        code_size += func.code.size();
+        wide_size += func.wide_size;
+    }
+    std::print("PROGRAM (num functions = {}, identical functions folded = {}, bytes saved = {})\n",
+               prog.functions.size(), num_folded, bytes_saved);
+    std::print("CODE SIZE (bytes = {}, before operand encoding = {})\n", code_size, wide_size);
     linebreak();
     for (const auto& func : prog.functions) {
         std::print("{} - id: {}\n", func.name, func.id);
+        for (const auto& name : func.merged_names) {
+            std::print("  also {}\n", name);
+        }
         linebreak();
         auto ptr = func.code.data();
         while (ptr < func.code.data() + func.code.size()) {
@@ -281,10 +712,73 @@ auto print_program(const bytecode_program& prog) -> void
         std::print("\n");
         linebreak();
     }
+    if (!prog.natives.empty()) {
+        std::print("NATIVES\n");
+        linebreak();
+        for (std::size_t id = 0; id != prog.natives.size(); ++id) {
+            std::print("{} - id: {}\n", prog.natives[id].name, id);
+        }
+        linebreak();
+    }
     std::print("ROM\n");
     linebreak();
     std::print("{}\n", prog.rom);
     linebreak();
 }
 
+// Every op has either a single immediate operand or only std::uint64_t operands
+auto narrowed_operands(op op_code) -> std::size_t
+{
+    return has_immediate_operand(op_code) ? 0 : operands_size(op_code) / sizeof(std::uint64_t);
+}
+
+auto encoded_operands_size(op op_code) -> std::size_t
+{
+    const auto narrowed = narrowed_operands(op_code);
+    return operands_size(op_code) - narrowed * (sizeof(std::uint64_t) - sizeof(bytecode_operand));
+}
+
+auto encode_operands(std::span<const std::byte> code) -> std::vector<std::byte>
+{
+    const auto read_op = [&](std::size_t pos) {
+        auto op_code = op{};
+        std::memcpy(&op_code, &code[pos], sizeof(op));
+        return op_code;
+    };
+
+    // Find where each op starts once encoded first, so that jumps can be retargeted
+    auto new_pos = std::vector<std::size_t>(code.size() + 1);
+    auto encoded_size = std::size_t{0};
+    for (std::size_t pos = 0; pos < code.size();) {
+        const auto op_code = read_op(pos);
+        new_pos[pos] = encoded_size;
+        encoded_size += sizeof(op) + encoded_operands_size(op_code);
+        pos += sizeof(op) + operands_size(op_code);
+    }
+    new_pos[code.size()] = encoded_size;
+
+    auto encoded = std::vector<std::byte>{};
+    encoded.reserve(encoded_size);
+    for (std::size_t pos = 0; pos < code.size();) {
+        const auto op_code = read_op(pos);
+        const auto operands = pos + sizeof(op);
+        push_value(encoded, op_code);
+        if (const auto narrowed = narrowed_operands(op_code); narrowed > 0) {
+            const auto is_jump = op_code == op::jump || op_code == op::jump_if_true || op_code == op::jump_if_false;
+            for (std::size_t i = 0; i != narrowed; ++i) {
+                auto value = std::uint64_t{};
+                std::memcpy(&value, &code[operands + i * sizeof(std::uint64_t)], sizeof(value));
+                if (is_jump) value = new_pos[value];
+                panic_if(value > std::numeric_limits<bytecode_operand>::max(), "operand {} too large to encode", value);
+                push_value(encoded, static_cast<bytecode_operand>(value));
+            }
+        } else {
+            const auto size = operands_size(op_code);
+            encoded.insert(encoded.end(), code.begin() + operands, code.begin() + operands + size);
+        }
+        pos = operands + operands_size(op_code);
+    }
+    return encoded;
+}
+
 }
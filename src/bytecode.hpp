@@ -1,20 +1,40 @@
 #pragma once
 #include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace anzu {
 
+// The compiler writes sizes, offsets, jump targets and ids as std::uint64_t operands so
+// that they can be patched and inspected easily. Once a function is complete, these are
+// narrowed to this type by encode_operands, and widened again by the runtime.
+using bytecode_operand = std::uint32_t;
+
 struct bytecode_function
 {
-    std::string            name;
-    std::size_t            id;
-    std::vector<std::byte> code;
+    std::string              name;
+    std::size_t              id;
+    std::vector<std::byte>   code;
+    std::vector<std::string> merged_names = {}; // identical functions folded into this one
+    std::size_t              wide_size    = 0;  // size of the code before encode_operands
+    std::size_t              return_size  = 0;  // checked by op::call_ptr against the call site
+};
+
+// Signature of a host function called via op::call_native. The args are read in full
+// before the result is written, so the two are allowed to overlap.
+using native_function_ptr = void(*)(const std::byte* args, std::byte* result);
+
+struct bytecode_native
+{
+    std::string         name;
+    native_function_ptr ptr;
 };
 
 struct bytecode_program
 {
     std::vector<bytecode_function> functions;
+    std::vector<bytecode_native>   natives;
     std::string                    rom;
 };
 
@@ -25,9 +45,15 @@ enum class op : std::uint8_t
 {
     end_program,
     
+    push_i8,
+    push_i16,
     push_i32,
     push_i64,
+    push_u8,
+    push_u16,
+    push_u32,
     push_u64,
+    push_f32,
     push_f64,
     push_char,
     push_bool,
@@ -35,10 +61,20 @@ enum class op : std::uint8_t
     push_nullptr,
 
     push_string_literal,
+    push_rom,
+    push_ptr_rom,
     push_ptr_global,
     push_ptr_local,
     push_val_global,
     push_val_local,
+    push_val_global_1,
+    push_val_global_4,
+    push_val_global_8,
+    push_val_global_16,
+    push_val_local_1,
+    push_val_local_4,
+    push_val_local_8,
+    push_val_local_16,
     push_function_ptr,
 
     nth_element_ptr,
@@ -51,11 +87,21 @@ enum class op : std::uint8_t
     arena_alloc,
     arena_alloc_array,
     arena_realloc_array,
+    arena_alloc_soa,
     arena_size,
     
     load,
     save,
+    load_1,
+    load_4,
+    load_8,
+    load_16,
+    save_1,
+    save_4,
+    save_8,
+    save_16,
     push,
+    push_zero,
     pop,
     memcpy,
     memcmp,
@@ -64,11 +110,24 @@ enum class op : std::uint8_t
     jump_if_false,
     call_static,
     call_ptr,
+    call_native,
     ret,
+    ret_local,
     assert,
 
     read_file,
 
+    channel_new,
+    channel_send,
+    channel_recv,
+    spawn,
+    join,
+    push_args,
+    atomic_load,
+    atomic_store,
+    atomic_add,
+    atomic_cas,
+
     null_to_i64,
     bool_to_i64,
     char_to_i64,
@@ -83,6 +142,22 @@ enum class op : std::uint8_t
     i64_to_u64,
     f64_to_u64,
 
+    // Narrow types have no arithmetic of their own, they are widened to the 64 bit type of
+    // the same kind, operated on and then narrowed back
+    i8_to_i64,
+    i16_to_i64,
+    u8_to_u64,
+    u16_to_u64,
+    u32_to_u64,
+    f32_to_f64,
+    i64_to_i8,
+    i64_to_i16,
+    u64_to_u8,
+    u64_to_u16,
+    u64_to_u32,
+    f64_to_f32,
+    i64_to_i32,
+
     char_eq,
     char_ne,
 
@@ -122,6 +197,29 @@ enum class op : std::uint8_t
     u64_gt,
     u64_ge,
 
+    i64_add_imm,
+    i64_sub_imm,
+    i64_mul_imm,
+    i64_div_imm,
+    i64_mod_imm,
+    i64_eq_imm,
+    i64_ne_imm,
+    i64_lt_imm,
+    i64_le_imm,
+    i64_gt_imm,
+    i64_ge_imm,
+    u64_add_imm,
+    u64_sub_imm,
+    u64_mul_imm,
+    u64_div_imm,
+    u64_mod_imm,
+    u64_eq_imm,
+    u64_ne_imm,
+    u64_lt_imm,
+    u64_le_imm,
+    u64_gt_imm,
+    u64_ge_imm,
+
     f64_add,
     f64_sub,
     f64_mul,
@@ -133,6 +231,51 @@ enum class op : std::uint8_t
     f64_gt,
     f64_ge,
 
+    // Bitwise ops act on the raw bits, so i64 shares them with u64 except for >>,
+    // and the other integer types are widened to 64 bits first
+    u64_and,
+    u64_or,
+    u64_xor,
+    u64_not,
+    u64_shl,
+    u64_shr,
+    i64_shr,
+    u64_popcount,
+    u64_ctz,
+    u64_clz,
+    u64_rotl,
+
+    // Bitset ops on the words of a std.bitset, given as a u64[], with the single bit ops
+    // checking the index against the size of the bitset
+    bits_set,
+    bits_clear,
+    bits_test,
+    bits_count,
+    bits_find_next,
+    bits_and,
+    bits_or,
+    bits_xor,
+
+    f64_sqrt,
+    f64_floor,
+    f64_ceil,
+    f64_round,
+    f64_exp,
+    f64_log,
+    f64_sin,
+    f64_cos,
+    f64_tan,
+    f64_pow,
+    f64_atan2,
+    i64_min,
+    i64_max,
+    u64_min,
+    u64_max,
+    f64_min,
+    f64_max,
+    i64_abs,
+    f64_abs,
+
     bool_eq,
     bool_ne,
     bool_not,
@@ -147,9 +290,23 @@ enum class op : std::uint8_t
     print_i32,
     print_i64,
     print_u64,
+    print_f32,
     print_f64,
     print_char_span,
     print_ptr,
 };
 
+// Returns the number of bytes taken up by the operands following the given op code, as
+// written by the compiler before encode_operands
+auto operands_size(op op_code) -> std::size_t;
+
+// Returns the number of operands of the op that encode_operands narrows, and the number
+// of bytes taken up by the operands once they have been
+auto narrowed_operands(op op_code) -> std::size_t;
+auto encoded_operands_size(op op_code) -> std::size_t;
+
+// Returns a copy of the code with every size, offset, jump target and id operand narrowed
+// to a bytecode_operand, with jumps retargeted to match
+auto encode_operands(std::span<const std::byte> code) -> std::vector<std::byte>;
+
 }
\ No newline at end of file
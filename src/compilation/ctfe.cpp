@@ -0,0 +1,152 @@
+#include "ctfe.hpp"
+#include "compiler.hpp"
+#include "verifier.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace anzu {
+namespace {
+
+// Calls that take longer than this are left to run at runtime
+constexpr auto max_ops = std::size_t{10'000'000};
+
+enum class purity { pure, impure, incomplete };
+
+auto check_purity(compiler& com, std::size_t id, std::unordered_set<std::size_t>& visited) -> purity
+{
+    if (std::ranges::find(com.current_function, id) != com.current_function.end()) {
+        return purity::incomplete; // still being compiled
+    }
+    if (const auto it = com.ctfe.is_pure.find(id); it != com.ctfe.is_pure.end()) {
+        return it->second ? purity::pure : purity::impure;
+    }
+    if (!visited.insert(id).second) {
+        return purity::pure; // recursive call, the outer check decides
+    }
+
+    const auto& code = com.functions[id].code;
+    for (auto ptr = code.data(); ptr < code.data() + code.size();) {
+        auto op_code = op{};
+        std::memcpy(&op_code, ptr, sizeof(op));
+        switch (op_code) {
+            // Ops with side effects or that touch state outside of the call
+            case op::push_ptr_global:
+            case op::push_val_global:
+            case op::push_val_global_1:
+            case op::push_val_global_4:
+            case op::push_val_global_8:
+            case op::push_val_global_16:
+            case op::call_ptr:
+            case op::call_native:
+            case op::assert:
+            case op::read_file:
+            case op::channel_new:
+            case op::channel_send:
+            case op::channel_recv:
+            case op::spawn:
+            case op::join:
+            case op::push_args:
+            case op::atomic_load:
+            case op::atomic_store:
+            case op::atomic_add:
+            case op::atomic_cas:
+            case op::print_null:
+            case op::print_bool:
+            case op::print_char:
+            case op::print_i32:
+            case op::print_i64:
+            case op::print_u64:
+            case op::print_f32:
+            case op::print_f64:
+            case op::print_char_span:
+            case op::print_ptr:
+                return purity::impure;
+            case op::call_static: {
+                auto callee = std::uint64_t{};
+                std::memcpy(&callee, ptr + sizeof(op), sizeof(callee));
+                if (const auto result = check_purity(com, callee, visited); result != purity::pure) {
+                    return result;
+                }
+            } break;
+            default: break;
+        }
+        ptr += sizeof(op) + operands_size(op_code);
+    }
+    return purity::pure;
+}
+
+}
+
+auto is_pure_function(compiler& com, std::size_t function_id) -> bool
+{
+    auto visited = std::unordered_set<std::size_t>{};
+    return check_purity(com, function_id, visited) == purity::pure;
+}
+
+auto try_evaluate_call(
+    compiler& com,
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::size_t return_size
+)
+    -> std::optional<std::vector<std::byte>>
+{
+    auto& state = com.ctfe;
+    auto key = ctfe_state::call_key{function_id, {args.begin(), args.end()}};
+    if (const auto it = state.results.find(key); it != state.results.end()) {
+        return it->second;
+    }
+
+    auto visited = std::unordered_set<std::size_t>{};
+    const auto result = check_purity(com, function_id, visited);
+    if (result == purity::incomplete) {
+        return std::nullopt; // may be possible later, so don't cache anything
+    }
+    state.is_pure[function_id] = result == purity::pure;
+    if (result == purity::impure) {
+        state.results.emplace(std::move(key), std::nullopt);
+        return std::nullopt;
+    }
+
+    // Everything reachable is complete, so their code will not change from here on. This
+    // code is run without going through compile, so it is verified here instead.
+    state.functions.resize(com.functions.size());
+    auto added = false;
+    for (const auto id : visited) {
+        auto& function = state.functions[id];
+        if (function.code.empty()) {
+            function = bytecode_function{
+                .name = com.functions[id].name.to_string(),
+                .id = id,
+                .code = encode_operands(com.functions[id].code),
+                .return_size = com.types.size_of(com.functions[id].return_type)
+            };
+            added = true;
+        }
+    }
+    if (added) {
+        const auto program = bytecode_program{.functions = state.functions, .rom = com.rom};
+        const auto ids = std::vector<std::size_t>(visited.begin(), visited.end());
+        if (const auto error = verify_subset(program, ids)) {
+            panic("compiler produced invalid bytecode: {}", *error);
+        }
+    }
+
+    if (!state.context) {
+        state.context = std::make_unique<bytecode_context>();
+    }
+    state.context->functions = state.functions;
+    state.context->rom = com.rom;
+
+    auto bytes = std::vector<std::byte>(return_size);
+    auto value = std::optional<std::vector<std::byte>>{};
+    if (call_function_limited(*state.context, function_id, args, bytes, max_ops)) {
+        value = std::move(bytes);
+    }
+    state.results.emplace(std::move(key), value);
+    return value;
+}
+
+}
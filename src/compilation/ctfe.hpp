@@ -0,0 +1,45 @@
+#pragma once
+#include "bytecode.hpp"
+#include "runtime.hpp"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace anzu {
+
+struct compiler;
+
+// State for compile time function evaluation. Calls are run on an embedded VM over the
+// functions compiled so far, so only functions that have been fully compiled can be used.
+struct ctfe_state
+{
+    std::unique_ptr<bytecode_context>     context;   // created on first use
+    std::vector<bytecode_function>        functions; // copies of the pure functions
+    std::unordered_map<std::size_t, bool> is_pure;
+
+    using call_key = std::pair<std::size_t, std::vector<std::byte>>;
+    std::map<call_key, std::optional<std::vector<std::byte>>> results;
+};
+
+// Attempts to evaluate a call to the given function with the given argument bytes.
+// This fails if the function, or anything it calls, has side effects or touches
+// memory outside of the call, or if it does not finish quickly enough.
+auto try_evaluate_call(
+    compiler& com,
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::size_t return_size
+)
+    -> std::optional<std::vector<std::byte>>;
+
+// True if the function, and everything it calls, has no side effects and touches no state
+// outside of the call. Functions that are still being compiled are never considered pure.
+auto is_pure_function(compiler& com, std::size_t function_id) -> bool;
+
+}
@@ -2,6 +2,14 @@
 #include "object.hpp"
 
 namespace anzu {
+namespace {
+
+auto round_up(std::size_t value, std::size_t align) -> std::size_t
+{
+    return (value + align - 1) / align * align;
+}
+
+}
 
 auto type_manager::add_type(const type_struct& name, const template_map& templates) -> bool
 {
@@ -38,15 +46,33 @@ auto type_manager::size_of(const type_name& type) const -> std::size_t
         [](type_char) {
             return std::size_t{1};
         },
+        [](type_i8) {
+            return std::size_t{1};
+        },
+        [](type_i16) {
+            return std::size_t{2};
+        },
         [](type_i32) {
             return std::size_t{4};
         },
         [](type_i64) {
             return std::size_t{8};
         },
+        [](type_u8) {
+            return std::size_t{1};
+        },
+        [](type_u16) {
+            return std::size_t{2};
+        },
+        [](type_u32) {
+            return std::size_t{4};
+        },
         [](type_u64) {
             return std::size_t{8};
         },
+        [](type_f32) {
+            return std::size_t{4};
+        },
         [](type_f64) {
             return std::size_t{8};
         },
@@ -65,8 +91,9 @@ auto type_manager::size_of(const type_name& type) const -> std::size_t
             }
             auto size = std::size_t{0};
             for (const auto& field : fields_of(t)) {
-                size += size_of(field.type);
+                size = round_up(size, align_of(field.type)) + size_of(field.type);
             }
+            size = round_up(size, align_of(type)); // trailing padding
             return std::max(std::size_t{1}, size); // empty structs take up one byte
         },
         [&](const type_array& t) {
@@ -78,6 +105,9 @@ auto type_manager::size_of(const type_name& type) const -> std::size_t
         [](const type_span&) {
             return sizeof(std::byte*) + sizeof(std::size_t);
         },
+        [](const type_channel&) {
+            return sizeof(std::byte*); // the channel itself lives in an arena
+        },
         [](const type_function_ptr&) {
             return sizeof(std::byte*);
         },
@@ -90,6 +120,9 @@ auto type_manager::size_of(const type_name& type) const -> std::size_t
         [](const type_function&) {
             return std::size_t{0};
         },
+        [](const type_native_function&) {
+            return std::size_t{0};
+        },
         [](const type_function_template&) {
             return std::size_t{0};
         },
@@ -118,4 +151,41 @@ auto type_manager::templates_of(const type_struct& t) const -> template_map
     return {};
 }
 
-}
\ No newline at end of file
+auto type_manager::align_of(const type_name& type) const -> std::size_t
+{
+    return std::visit(overloaded{
+        [&](const type_struct& t) {
+            if (!d_classes.contains(t)) {
+                panic("unknown type '{}'", type);
+            }
+            auto align = std::size_t{1};
+            for (const auto& field : fields_of(t)) {
+                align = std::max(align, align_of(field.type));
+            }
+            return align;
+        },
+        [&](const type_array& t) {
+            return align_of(*t.inner_type);
+        },
+        [&](const auto&) {
+            // Everything else is a fundamental type or made up of pointers and sizes, so
+            // is aligned to its size, with zero size types having no requirement at all
+            return std::clamp(size_of(type), std::size_t{1}, sizeof(std::size_t));
+        }
+    }, type);
+}
+
+auto type_manager::offset_of(const type_struct& t, const std::string& field_name) const -> std::optional<std::size_t>
+{
+    auto offset = std::size_t{0};
+    for (const auto& field : fields_of(t)) {
+        offset = round_up(offset, align_of(field.type));
+        if (field.name == field_name) {
+            return offset;
+        }
+        offset += size_of(field.type);
+    }
+    return std::nullopt;
+}
+
+}
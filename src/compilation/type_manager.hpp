@@ -1,6 +1,7 @@
 #pragma once
 #include "object.hpp"
 
+#include <optional>
 #include <unordered_map>
 
 namespace anzu {
@@ -29,7 +30,11 @@ public:
     auto add_field(const type_struct& name, const type_field& field) -> bool;
     auto contains(const type_struct& t) const -> bool;
 
+    // Struct fields are naturally aligned, and the size of a type is always a multiple
+    // of its alignment so that elements of an array are aligned too
     auto size_of(const type_name& t) const -> std::size_t;
+    auto align_of(const type_name& t) const -> std::size_t;
+    auto offset_of(const type_struct& t, const std::string& field) const -> std::optional<std::size_t>;
     auto fields_of(const type_struct& t) const -> type_fields;
     auto templates_of(const type_struct& t) const -> template_map;
 };
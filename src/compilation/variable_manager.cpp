@@ -9,7 +9,7 @@ auto delete_arenas_in_scope(std::vector<std::byte>& program, const scope& scope,
     for (const auto& var : scope.variables | std::views::reverse) {
         if (var.type.is<type_arena>()) {
             const auto op = is_local ? op::push_ptr_local : op::push_ptr_global;
-            push_value(program, op, var.location, op::load, sizeof(std::byte*), op::arena_delete);
+            push_value(program, op, var.location, op::load_8, op::arena_delete);
         }
     }
 }
@@ -48,6 +48,27 @@ auto variable_manager::declare(
     return true;
 }
 
+auto variable_manager::declare_rom(
+    const std::filesystem::path& module,
+    const std::string& name,
+    const type_name& type,
+    std::size_t rom_location
+) -> bool
+{
+    auto& scope = d_scopes.back();
+    for (const auto& var : scope.variables) {
+        if (var.name == name && var.module == module) return false;
+    }
+
+    scope.variables.emplace_back(module, name, type, 0, 0, const_value{}, rom_location);
+    return true;
+}
+
+auto variable_manager::skip(std::size_t size) -> void
+{
+    d_scopes.back().next += size;
+}
+
 auto variable_manager::find(const std::filesystem::path& module, const std::string& name) const -> std::optional<variable>
 {
     for (const auto& scope : d_scopes | std::views::reverse) {
@@ -24,6 +24,9 @@ struct variable
     std::size_t           location;
     std::size_t           size;
     const_value           value;
+
+    // Set for const arrays that live in the rom rather than on the stack
+    std::optional<std::size_t> rom_location = {};
 };
 
 struct simple_scope
@@ -62,6 +65,18 @@ public:
         const const_value& value
     ) -> bool;
 
+    // Declares a const variable whose value is stored in the rom, taking up no stack space
+    auto declare_rom(
+        const std::filesystem::path& module,
+        const std::string& name,
+        const type_name& type,
+        std::size_t rom_location
+    ) -> bool;
+
+    // Reserves stack space in the current scope that is not bound to a name, such as the
+    // padding between the fields of an unpacked struct
+    auto skip(std::size_t size) -> void;
+
     auto find(const std::filesystem::path& module, const std::string& name) const -> std::optional<variable>;
     auto scopes() const -> std::span<const scope> { return d_scopes; }
 
@@ -3,9 +3,12 @@
 #include "lexer.hpp"
 #include "object.hpp"
 #include "parser.hpp"
+#include "verifier.hpp"
 #include "utility/common.hpp"
 #include "utility/memory.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <string_view>
 #include <optional>
 #include <tuple>
@@ -16,6 +19,8 @@
 #include <unordered_set>
 #include <source_location>
 #include <functional>
+#include <fstream>
+#include <iterator>
 
 namespace anzu {
 namespace {
@@ -71,9 +76,15 @@ auto get_fundamental_type(const std::string& name) -> std::optional<type_name>
     if (name == "null")   return type_name(type_null{});
     if (name == "bool")   return type_name(type_bool{});
     if (name == "char")   return type_name(type_char{});
+    if (name == "i8")     return type_name(type_i8{});
+    if (name == "i16")    return type_name(type_i16{});
     if (name == "i32")    return type_name(type_i32{});
     if (name == "i64")    return type_name(type_i64{});
+    if (name == "u8")     return type_name(type_u8{});
+    if (name == "u16")    return type_name(type_u16{});
+    if (name == "u32")    return type_name(type_u32{});
     if (name == "u64")    return type_name(type_u64{});
+    if (name == "f32")    return type_name(type_f32{});
     if (name == "f64")    return type_name(type_f64{});
     if (name == "module") return type_name(type_module{});
     if (name == "arena")  return type_name(type_arena{});
@@ -135,12 +146,21 @@ void declare_var(
     if (!current(com).variables.declare(curr_module(com), name, type, com.types.size_of(type), value)) {
         tok.error("name already in use: '{}'", name);
     }
+
+    // Variable offsets are encoded as 32 bit operands
+    constexpr auto max_offset = std::numeric_limits<bytecode_operand>::max();
+    tok.assert(current(com).variables.scopes().back().next <= max_offset,
+               "variable '{}' does not fit, the variables in scope would take more than {} bytes", name, max_offset);
 }
 
 auto push_var_addr(compiler& com, const token& tok, const std::filesystem::path& module, const std::string& name) -> expr_result
 {
     if (in_function(com)) {
         if (const auto var = variables(com).find(module, name); var.has_value()) {
+            if (var->rom_location) {
+                push_value(code(com), op::push_ptr_rom, *var->rom_location);
+                return {var->type};
+            }
             push_value(code(com), op::push_ptr_local, var->location);
             return {var->type};
         }
@@ -148,17 +168,68 @@ auto push_var_addr(compiler& com, const token& tok, const std::filesystem::path&
 
     const auto var = globals(com).find(module, name);
     tok.assert(var.has_value(), "could not find variable '{}'\n", name);
+    if (var->rom_location) {
+        push_value(code(com), op::push_ptr_rom, *var->rom_location);
+        return {var->type};
+    }
     push_value(code(com), op::push_ptr_global, var->location);
     return {var->type};
 }
 
+// The common sizes of load, save and push_val have their own ops with the size built in
+auto push_load(compiler& com, std::size_t size) -> void
+{
+    switch (size) {
+        case 1:  push_value(code(com), op::load_1);  break;
+        case 4:  push_value(code(com), op::load_4);  break;
+        case 8:  push_value(code(com), op::load_8);  break;
+        case 16: push_value(code(com), op::load_16); break;
+        default: push_value(code(com), op::load, size);
+    }
+}
+
+auto push_save(compiler& com, std::size_t size) -> void
+{
+    switch (size) {
+        case 1:  push_value(code(com), op::save_1);  break;
+        case 4:  push_value(code(com), op::save_4);  break;
+        case 8:  push_value(code(com), op::save_8);  break;
+        case 16: push_value(code(com), op::save_16); break;
+        default: push_value(code(com), op::save, size);
+    }
+}
+
+auto push_val_local(compiler& com, std::size_t location, std::size_t size) -> void
+{
+    switch (size) {
+        case 1:  push_value(code(com), op::push_val_local_1,  location); break;
+        case 4:  push_value(code(com), op::push_val_local_4,  location); break;
+        case 8:  push_value(code(com), op::push_val_local_8,  location); break;
+        case 16: push_value(code(com), op::push_val_local_16, location); break;
+        default: push_value(code(com), op::push_val_local, location, size);
+    }
+}
+
+auto push_val_global(compiler& com, std::size_t location, std::size_t size) -> void
+{
+    switch (size) {
+        case 1:  push_value(code(com), op::push_val_global_1,  location); break;
+        case 4:  push_value(code(com), op::push_val_global_4,  location); break;
+        case 8:  push_value(code(com), op::push_val_global_8,  location); break;
+        case 16: push_value(code(com), op::push_val_global_16, location); break;
+        default: push_value(code(com), op::push_val_global, location, size);
+    }
+}
+
 auto push_var_val(compiler& com, const token& tok, const std::filesystem::path& module, const std::string& name) -> expr_result
 {
     if (in_function(com)) {
         if (const auto var = variables(com).find(module, name); var.has_value()) {
             const auto size = com.types.size_of(var->type);
-            if (size > 0) {
-                push_value(code(com), op::push_val_local, var->location, size);
+            if (var->rom_location) {
+                push_value(code(com), op::push_rom, *var->rom_location, size);
+            } else if (size > 0) {
+                push_val_local(com, var->location, size);
             }
             return { var->type, var->value };
         }
@@ -167,8 +238,10 @@ auto push_var_val(compiler& com, const token& tok, const std::filesystem::path&
     const auto var = globals(com).find(module, name);
     tok.assert(var.has_value(), "could not find variable '{}'\n", name);
     const auto size = com.types.size_of(var->type);
-    if (size > 0) {
-        push_value(code(com), op::push_val_global, var->location, size);
+    if (var->rom_location) {
+        push_value(code(com), op::push_rom, *var->rom_location, size);
+    } else if (size > 0) {
+        push_val_global(com, var->location, size);
     }
     return { var->type, var->value };
 }
@@ -180,30 +253,16 @@ auto push_field_offset(
 )
     -> type_name
 {
-    auto offset = std::size_t{0};
     for (const auto& field : com.types.fields_of(type)) {
         if (field.name == field_name) {
-            push_value(code(com), op::push_u64, offset);
+            push_value(code(com), op::push_u64, *com.types.offset_of(type, field_name));
             return field.type;
         }
-        offset += com.types.size_of(field.type);
     }
     
     tok.error("could not find field '{}' for type '{}'\n", field_name, type);
 }
 
-auto constructor_params(const compiler& com, const type_name& type) -> std::vector<type_name>
-{
-    if (type.is<type_struct>()) {
-        auto params = std::vector<type_name>{};
-        for (const auto& field : com.types.fields_of(type.as<type_struct>())) {
-            params.emplace_back(field.type);
-        }
-        return params;
-    }
-    return {type};
-}
-
 // Gets the type of the expression by compiling it, then removes the added
 // op codes to leave the program unchanged before returning the type.
 auto type_of_expr(compiler& com, const node_expr& node) -> expr_result
@@ -228,13 +287,74 @@ auto insert_into_rom(compiler& com, std::string_view data) -> std::size_t
     return ptr;
 }
 
+// If everything pushed since the given position in the current function is an immediate
+// value, replaces those ops with a single copy of the combined bytes from the rom
+auto fold_constant_pushes(compiler& com, std::size_t begin) -> void
+{
+    auto& bytecode = code(com);
+    auto bytes = std::string{};
+    auto num_ops = std::size_t{0};
+    for (auto ptr = bytecode.data() + begin; ptr < bytecode.data() + bytecode.size(); ++num_ops) {
+        auto op_code = op{};
+        std::memcpy(&op_code, ptr, sizeof(op));
+        const auto operands = reinterpret_cast<const char*>(ptr + sizeof(op));
+        switch (op_code) {
+            case op::push_bool:
+            case op::push_char:
+            case op::push_i8:
+            case op::push_i16:
+            case op::push_i32:
+            case op::push_i64:
+            case op::push_u8:
+            case op::push_u16:
+            case op::push_u32:
+            case op::push_u64:
+            case op::push_f32:
+            case op::push_f64: {
+                bytes.append(operands, operands_size(op_code));
+            } break;
+            case op::push_null: {
+                bytes.push_back('\0');
+            } break;
+            case op::push_rom: {
+                auto index = std::uint64_t{};
+                auto size = std::uint64_t{};
+                std::memcpy(&index, operands, sizeof(index));
+                std::memcpy(&size, operands + sizeof(index), sizeof(size));
+                bytes.append(com.rom, index, size);
+            } break;
+            default: return;
+        }
+        ptr += sizeof(op) + operands_size(op_code);
+    }
+
+    if (num_ops > 1) {
+        bytecode.resize(begin);
+        push_value(bytecode, op::push_rom, insert_into_rom(com, bytes), bytes.size());
+    }
+}
+
+// Returns the rom index of the data if the code since the given position is just a copy
+// from the rom, which lets const variables refer to the rom directly
+auto rom_location_of_pushes(compiler& com, std::size_t begin) -> std::optional<std::size_t>
+{
+    const auto& bytecode = code(com);
+    if (bytecode.size() - begin != sizeof(op) + operands_size(op::push_rom)) return std::nullopt;
+    auto op_code = op{};
+    std::memcpy(&op_code, &bytecode[begin], sizeof(op));
+    if (op_code != op::push_rom) return std::nullopt;
+    auto index = std::uint64_t{};
+    std::memcpy(&index, &bytecode[begin + sizeof(op)], sizeof(index));
+    return index;
+}
+
 // Given a type, push the number of op::load calls required to dereference away all the pointers.
 // If the type is not a pointer, this is a noop.
 auto auto_deref_pointer(compiler& com, const type_name& type) -> type_name
 {
     auto t = type;
     while (t.is<type_ptr>()) {
-        push_value(code(com), op::load, sizeof(std::byte*));
+        push_load(com, sizeof(std::byte*));
         t = t.remove_ptr();
     }
     return t;
@@ -270,6 +390,18 @@ auto const_convertable_to(const token& tok, const type_name& src, const type_nam
     }, src, dst);
 }
 
+// Arenas own their memory so can never be copied, and otherwise the types must match up to const
+void check_copyable(const token& tok, const type_name& actual, const type_name& expected)
+{
+    if (actual.is<type_arena>() || expected.is<type_arena>()) {
+        tok.error("arenas can not be copied or assigned");
+    }
+
+    if (!const_convertable_to(tok, actual, expected)) {
+        tok.error("Cannot convert '{}' to '{}'", actual, expected);
+    }
+}
+
 // Used for passing copies of variables to functions, as well as for assignments and declarations.
 // Verifies that the type of the expression can be converted to the type 
 void push_copy_typechecked(compiler& com, const node_expr& expr, const type_name& expected_raw, const token& tok)
@@ -304,13 +436,7 @@ void push_copy_typechecked(compiler& com, const node_expr& expr, const type_name
         return;
     }
 
-    if (actual.is<type_arena>() || expected.is<type_arena>()) {
-        tok.error("arenas can not be copied or assigned");
-    }
-
-    if (!const_convertable_to(tok, actual, expected)) {
-        tok.error("Cannot convert '{}' to '{}'", actual, expected);
-    }
+    check_copyable(tok, actual, expected);
 }
 
 void push_break(compiler& com, const token& tok)
@@ -338,6 +464,279 @@ auto ends_in_return(const node_stmt& node) -> bool
     }, node);
 }
 
+template <typename T>
+concept literal_node = std::same_as<T, node_literal_i8_expr>
+                    || std::same_as<T, node_literal_i16_expr>
+                    || std::same_as<T, node_literal_i32_expr>
+                    || std::same_as<T, node_literal_i64_expr>
+                    || std::same_as<T, node_literal_u8_expr>
+                    || std::same_as<T, node_literal_u16_expr>
+                    || std::same_as<T, node_literal_u32_expr>
+                    || std::same_as<T, node_literal_u64_expr>
+                    || std::same_as<T, node_literal_f32_expr>
+                    || std::same_as<T, node_literal_f64_expr>
+                    || std::same_as<T, node_literal_char_expr>
+                    || std::same_as<T, node_literal_bool_expr>
+                    || std::same_as<T, node_literal_null_expr>;
+
+// Returns the variable at the root of an access path such as 'a.b[c]', if there is one
+auto root_name(const node_expr& node) -> const std::string*
+{
+    return std::visit(overloaded{
+        [](const node_name_expr& n) -> const std::string* { return &n.name; },
+        [](const node_field_expr& n)     { return root_name(*n.expr); },
+        [](const node_subscript_expr& n) { return root_name(*n.expr); },
+        [](const node_span_expr& n)      { return root_name(*n.expr); },
+        [](const auto&) -> const std::string* { return nullptr; }
+    }, node);
+}
+
+// True if the expression is a chain of field accesses on a variable that is currently in
+// scope and evaluates to a span. Names in the given set are declared later and may shadow
+// the variables that are visible now, so they are never treated as spans.
+auto is_span_path(compiler& com, const std::unordered_set<std::string>& declared, const node_expr& node) -> bool
+{
+    auto root = &node;
+    while (std::holds_alternative<node_field_expr>(*root)) {
+        root = std::get<node_field_expr>(*root).expr.get();
+    }
+    if (!std::holds_alternative<node_name_expr>(*root)) return false;
+    const auto& name = std::get<node_name_expr>(*root).name;
+    if (declared.contains(name)) return false;
+    const auto var = in_function(com) ? variables(com).find(curr_module(com), name) : std::nullopt;
+    if (!var && !globals(com).find(curr_module(com), name)) return false;
+    return type_of_expr(com, node).type.is<type_span>();
+}
+
+// A conservative summary of what a piece of code may modify
+struct side_effects
+{
+    std::unordered_set<std::string> declared;  // declared within the code
+    std::unordered_set<std::string> assigned;  // assigned to, or their address is taken
+    std::unordered_set<std::string> addressed; // their address may be taken
+    bool writes_memory = false;                // may write through a pointer or call a function that might
+};
+
+// True if the name refers to a local pointer that is in scope before the code runs. Access
+// paths that start at such a local, like 'self.x', dereference it and so only read it.
+auto is_local_pointer(compiler& com, const side_effects& effects, const std::string& name) -> bool
+{
+    if (!in_function(com) || effects.declared.contains(name)) return false;
+    const auto var = variables(com).find(curr_module(com), name);
+    return var && var->type.is<type_ptr>();
+}
+
+// Records that the address of what an access path refers to may be taken. Binding an object
+// to a member function also dereferences the path if it is a pointer.
+auto take_address(compiler& com, side_effects& effects, const node_expr& node, bool derefs = false) -> void
+{
+    const auto root = root_name(node);
+    if (!root) return;
+    const auto is_path = !std::holds_alternative<node_name_expr>(node);
+    if ((is_path || derefs) && is_local_pointer(com, effects, *root)) return;
+    effects.addressed.insert(*root);
+    effects.assigned.insert(*root);
+}
+
+// The function a call expression calls, if it can be found without compiling anything, so
+// that this is safe on code that may never be compiled. Only plain function calls in the
+// current module and member function calls on locals in scope are recognised.
+auto direct_callee(compiler& com, const side_effects& effects, const node_call_expr& node)
+    -> std::optional<std::size_t>
+{
+    if (const auto name = std::get_if<node_name_expr>(&*node.expr)) {
+        const auto fname = function_name{curr_module(com), no_struct, name->name};
+        if (const auto it = com.functions_by_name.find(fname); it != com.functions_by_name.end()) {
+            return it->second;
+        }
+    }
+    else if (const auto field = std::get_if<node_field_expr>(&*node.expr)) {
+        const auto object = std::get_if<node_name_expr>(&*field->expr);
+        if (!object || !in_function(com) || effects.declared.contains(object->name)) return {};
+        if (com.functions_by_name.contains(function_name{curr_module(com), no_struct, object->name})) return {};
+        const auto var = variables(com).find(curr_module(com), object->name);
+        if (!var) return {};
+        const auto stripped = strip_pointers(var->type);
+        if (!stripped.is<type_struct>()) return {};
+        const auto& struct_name = stripped.as<type_struct>();
+        const auto fname = function_name{struct_name.module, struct_name, field->name};
+        if (const auto it = com.functions_by_name.find(fname); it != com.functions_by_name.end()) {
+            return it->second;
+        }
+    }
+    return {};
+}
+
+// True if calling the function only reads memory, so calls with the same arguments give the
+// same result as long as nothing they can see is written in between
+auto is_read_only(compiler& com, std::size_t id) -> bool
+{
+    return !com.functions[id].writes_memory && is_pure_function(com, id);
+}
+
+auto collect_declared_names(const name_pack& names, std::unordered_set<std::string>& declared) -> void
+{
+    std::visit(overloaded{
+        [&](const std::string& name) { declared.insert(name); },
+        [&](const std::vector<name_pack>& packs) {
+            for (const auto& pack : packs) collect_declared_names(pack, declared);
+        }
+    }, names.names);
+}
+
+auto collect_declared_names(const node_stmt& node, std::unordered_set<std::string>& declared) -> void
+{
+    std::visit(overloaded{
+        [&](const node_sequence_stmt& n) {
+            for (const auto& stmt : n.sequence) collect_declared_names(*stmt, declared);
+        },
+        [&](const node_loop_stmt& n)  { collect_declared_names(*n.body, declared); },
+        [&](const node_while_stmt& n) { collect_declared_names(*n.body, declared); },
+        [&](const node_for_stmt& n) {
+            collect_declared_names(n.names, declared);
+            collect_declared_names(*n.body, declared);
+        },
+        [&](const node_if_stmt& n) {
+            collect_declared_names(*n.body, declared);
+            if (n.else_body) collect_declared_names(*n.else_body, declared);
+        },
+        [&](const node_declaration_stmt& n)       { collect_declared_names(n.names, declared); },
+        [&](const node_arena_declaration_stmt& n) { declared.insert(n.name); },
+        [](const auto&) {}
+    }, node);
+}
+
+// Intrinsics that neither write to memory nor take the address of their arguments
+auto is_pure_intrinsic(const std::string& name) -> bool
+{
+    static const auto pure = std::unordered_set<std::string>{
+        "size_of", "align_of", "offset_of", "type_of", "type_name_of", "is_fundamental",
+        "is_span", "fn_ptr", "compare", "args", "soa", "channel", "popcount", "ctz", "clz",
+        "rotl", "sqrt", "floor", "ceil", "round", "exp", "log", "sin", "cos", "tan", "pow",
+        "atan2", "min", "max", "abs", "bits_test", "bits_count", "bits_find_next"
+    };
+    return pure.contains(name);
+}
+
+auto collect_side_effects(compiler& com, const node_expr& node, side_effects& effects) -> void
+{
+    const auto recurse = [&](const node_expr_ptr& expr) {
+        if (expr) collect_side_effects(com, *expr, effects);
+    };
+    std::visit(overloaded{
+        [&](const node_unary_op_expr& n)  { recurse(n.expr); },
+        [&](const node_binary_op_expr& n) { recurse(n.lhs); recurse(n.rhs); },
+        [&](const node_call_expr& n) {
+            // Member functions may be given a pointer to the object they are called on
+            if (std::holds_alternative<node_field_expr>(*n.expr)) {
+                take_address(com, effects, *std::get<node_field_expr>(*n.expr).expr, true);
+            }
+            if (const auto callee = direct_callee(com, effects, n); !callee || !is_read_only(com, *callee)) {
+                effects.writes_memory = true;
+            }
+            recurse(n.expr);
+            for (const auto& arg : n.args) recurse(arg);
+        },
+        [&](const node_template_expr& n) { recurse(n.expr); },
+        [&](const node_array_expr& n) {
+            for (const auto& element : n.elements) recurse(element);
+        },
+        [&](const node_repeat_array_expr& n) { recurse(n.value); },
+        [&](const node_addrof_expr& n) {
+            take_address(com, effects, *n.expr);
+            recurse(n.expr);
+        },
+        [&](const node_span_expr& n) {
+            // Slicing an array gives a span into the variable itself, slicing a span does not
+            if (!is_span_path(com, effects.declared, *n.expr)) {
+                take_address(com, effects, *n.expr);
+            }
+            recurse(n.expr);
+            recurse(n.lower_bound);
+            recurse(n.upper_bound);
+        },
+        [&](const node_const_expr& n)     { recurse(n.expr); },
+        [&](const node_field_expr& n)     { recurse(n.expr); },
+        [&](const node_deref_expr& n)     { recurse(n.expr); },
+        [&](const node_subscript_expr& n) { recurse(n.expr); recurse(n.index); },
+        [&](const node_new_expr& n) {
+            effects.writes_memory = true;
+            recurse(n.arena);
+            recurse(n.count);
+            recurse(n.original);
+            recurse(n.expr);
+        },
+        [&](const node_ternary_expr& n) {
+            recurse(n.condition);
+            recurse(n.true_case);
+            recurse(n.false_case);
+        },
+        [&](const node_intrinsic_expr& n) {
+            // @len on a span only reads it, but on a struct it calls the struct's len function
+            const auto span_len = n.name == "len" && n.args.size() == 1
+                               && is_span_path(com, effects.declared, *n.args[0]);
+            if (!span_len && !is_pure_intrinsic(n.name)) {
+                effects.writes_memory = true;
+                if (n.name == "len" && n.args.size() == 1) take_address(com, effects, *n.args[0]);
+            }
+            for (const auto& arg : n.args) recurse(arg);
+        },
+        [&](const node_as_expr& n) { recurse(n.expr); },
+        [](const auto&) {}
+    }, node);
+}
+
+auto collect_side_effects(compiler& com, const node_stmt& node, side_effects& effects) -> void
+{
+    const auto recurse_expr = [&](const node_expr_ptr& expr) {
+        if (expr) collect_side_effects(com, *expr, effects);
+    };
+    const auto recurse_stmt = [&](const node_stmt_ptr& stmt) {
+        if (stmt) collect_side_effects(com, *stmt, effects);
+    };
+    std::visit(overloaded{
+        [&](const node_sequence_stmt& n) {
+            for (const auto& stmt : n.sequence) recurse_stmt(stmt);
+        },
+        [&](const node_loop_stmt& n)  { recurse_stmt(n.body); },
+        [&](const node_while_stmt& n) { recurse_expr(n.condition); recurse_stmt(n.body); },
+        [&](const node_for_stmt& n) {
+            // Iterators are advanced by calling functions, and pointer loops write through elements
+            effects.writes_memory = true;
+            take_address(com, effects, *n.iter);
+            recurse_expr(n.iter);
+            recurse_stmt(n.body);
+        },
+        [&](const node_if_stmt& n) {
+            recurse_expr(n.condition);
+            recurse_stmt(n.body);
+            recurse_stmt(n.else_body);
+        },
+        [&](const node_declaration_stmt& n) { recurse_expr(n.expr); },
+        [&](const node_assignment_stmt& n) {
+            const auto is_path = !std::holds_alternative<node_name_expr>(*n.position);
+            const auto root = root_name(*n.position);
+            if (root && !(is_path && is_local_pointer(com, effects, *root))) {
+                effects.assigned.insert(*root);
+            }
+            // Globals and locals whose address is taken may also be read through pointers
+            const auto plain_local = root && !is_path && in_function(com)
+                && !current(com).address_taken.contains(*root)
+                && (effects.declared.contains(*root) || variables(com).find(curr_module(com), *root));
+            if (!plain_local) effects.writes_memory = true;
+            recurse_expr(n.position);
+            recurse_expr(n.expr);
+        },
+        [&](const node_expression_stmt& n) { recurse_expr(n.expr); },
+        [&](const node_return_stmt& n)     { recurse_expr(n.return_value); },
+        [&](const node_assert_stmt& n)     { recurse_expr(n.expr); },
+        [&](const node_print_stmt& n) {
+            for (const auto& arg : n.args) recurse_expr(arg);
+        },
+        [](const auto&) {}
+    }, node);
+}
+
 auto build_template_map(
     compiler& com,
     const token& tok,
@@ -458,6 +857,12 @@ auto compile_function(
     const auto return_type = ast_return_type ? resolve_type(com, tok, ast_return_type) : type_name{type_null{}};
     current(com).return_type = return_type;
 
+    auto effects = side_effects{};
+    collect_declared_names(*body, effects.declared);
+    collect_side_effects(com, *body, effects);
+    current(com).address_taken = std::move(effects.addressed);
+    current(com).writes_memory = effects.writes_memory;
+
     // this can cause other template functions to be compiled so any references to function
     // info above may be invalidated!
     push_stmt(com, *body);
@@ -512,9 +917,15 @@ auto push_print_fundamental(compiler& com, const node_expr& node, const token& t
         [&] (type_null)          { push_value(code(com), op::print_null); },
         [&] (type_bool)          { push_value(code(com), op::print_bool); },
         [&] (type_char)          { push_value(code(com), op::print_char); },
+        [&] (type_i8)            { push_value(code(com), op::i8_to_i64, op::print_i64);  },
+        [&] (type_i16)           { push_value(code(com), op::i16_to_i64, op::print_i64); },
         [&] (type_i32)           { push_value(code(com), op::print_i32);  },
         [&] (type_i64)           { push_value(code(com), op::print_i64);  },
+        [&] (type_u8)            { push_value(code(com), op::u8_to_u64, op::print_u64);  },
+        [&] (type_u16)           { push_value(code(com), op::u16_to_u64, op::print_u64); },
+        [&] (type_u32)           { push_value(code(com), op::u32_to_u64, op::print_u64); },
         [&] (type_u64)           { push_value(code(com), op::print_u64);  },
+        [&] (type_f32)           { push_value(code(com), op::print_f32);  },
         [&] (type_f64)           { push_value(code(com), op::print_f64);  },
         [&] (const type_ptr&)    { push_value(code(com), op::print_ptr);  },
         [&] (const type_span& t) {
@@ -615,6 +1026,140 @@ auto push_args_typechecked(compiler& com, const token& tok, const auto& args, co
     return args_size;
 }
 
+// Pushes the fields of a struct one at a time, along with the padding needed to keep each
+// of them aligned. Padding is zeroed since @compare compares whole objects bytewise.
+auto push_constructor_args(compiler& com, const token& tok, const auto& args, const type_name& type) -> void
+{
+    if (!type.is<type_struct>()) {
+        push_args_typechecked(com, tok, args, std::array{type});
+        return;
+    }
+
+    const auto& name = type.as<type_struct>();
+    const auto fields = com.types.fields_of(name);
+    tok.assert_eq(args.size(), fields.size(), "invalid number of args for function call");
+    auto size = std::size_t{0};
+    for (const auto& [arg, field] : std::views::zip(args, fields)) {
+        const auto offset = *com.types.offset_of(name, field.name);
+        if (offset > size) push_value(code(com), op::push_zero, offset - size);
+        push_copy_typechecked(com, *arg, field.type, tok);
+        size = offset + com.types.size_of(field.type);
+    }
+    const auto total = com.types.size_of(type);
+    if (total > size) push_value(code(com), op::push_zero, total - size);
+}
+
+// Types that contain no pointers, so values of them can be computed at compile time
+auto is_plain_data(const compiler& com, const type_name& type) -> bool
+{
+    return std::visit(overloaded{
+        [](type_null) { return true; },
+        [](type_bool) { return true; },
+        [](type_char) { return true; },
+        [](type_i8)   { return true; },
+        [](type_i16)  { return true; },
+        [](type_i32)  { return true; },
+        [](type_i64)  { return true; },
+        [](type_u8)   { return true; },
+        [](type_u16)  { return true; },
+        [](type_u32)  { return true; },
+        [](type_u64)  { return true; },
+        [](type_f32)  { return true; },
+        [](type_f64)  { return true; },
+        [&](const type_array& t) { return is_plain_data(com, *t.inner_type); },
+        [&](const type_struct& t) {
+            return std::ranges::all_of(com.types.fields_of(t), [&](const type_field& field) {
+                return is_plain_data(com, field.type);
+            });
+        },
+        [](const auto&) { return false; }
+    }, type);
+}
+
+// Appends the bytes of a compile time value, returning false if it has no runtime representation
+auto append_const_value(std::vector<std::byte>& bytes, const const_value& value) -> bool
+{
+    return std::visit([&] <typename T> (const T& v) {
+        if constexpr (std::is_arithmetic_v<T>) {
+            push_value(bytes, v);
+            return true;
+        }
+        return false;
+    }, value);
+}
+
+// Pushes a value that was computed at compile time. Fundamental types are pushed as an
+// immediate value which is also known to the compiler, anything else is copied from rom.
+auto push_const_bytes(compiler& com, const type_name& type, const std::vector<std::byte>& bytes) -> expr_result
+{
+    const auto push_fundamental = [&] <typename T> (op op_code) -> expr_result {
+        auto value = T{};
+        std::memcpy(&value, bytes.data(), sizeof(T));
+        push_value(code(com), op_code, value);
+        return { type, value };
+    };
+
+    if (type.is<type_bool>()) return push_fundamental.operator()<bool>(op::push_bool);
+    if (type.is<type_char>()) return push_fundamental.operator()<char>(op::push_char);
+    if (type.is<type_i8>())   return push_fundamental.operator()<std::int8_t>(op::push_i8);
+    if (type.is<type_i16>())  return push_fundamental.operator()<std::int16_t>(op::push_i16);
+    if (type.is<type_i32>())  return push_fundamental.operator()<std::int32_t>(op::push_i32);
+    if (type.is<type_i64>())  return push_fundamental.operator()<std::int64_t>(op::push_i64);
+    if (type.is<type_u8>())   return push_fundamental.operator()<std::uint8_t>(op::push_u8);
+    if (type.is<type_u16>())  return push_fundamental.operator()<std::uint16_t>(op::push_u16);
+    if (type.is<type_u32>())  return push_fundamental.operator()<std::uint32_t>(op::push_u32);
+    if (type.is<type_u64>())  return push_fundamental.operator()<std::uint64_t>(op::push_u64);
+    if (type.is<type_f32>())  return push_fundamental.operator()<float>(op::push_f32);
+    if (type.is<type_f64>())  return push_fundamental.operator()<double>(op::push_f64);
+
+    const auto data = std::string_view{reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+    push_value(code(com), op::push_rom, insert_into_rom(com, data), bytes.size());
+    return { type };
+}
+
+auto push_const_value(compiler& com, const type_name& type, const const_value& value) -> expr_result
+{
+    auto bytes = std::vector<std::byte>{};
+    append_const_value(bytes, value);
+    return push_const_bytes(com, type, bytes);
+}
+
+// If all the args are known at compile time and the function is pure, the call is evaluated
+// now and the result is pushed instead of the call. Returns nullopt if this is not possible.
+auto push_constant_call(compiler& com, const std::vector<node_expr_ptr>& args, const type_function& func)
+    -> std::optional<expr_result>
+{
+    const auto& return_type = *func.return_type;
+    const auto return_size = com.types.size_of(return_type);
+    if (return_size == 0 || !is_plain_data(com, return_type) || args.size() != func.param_types.size()) {
+        return std::nullopt;
+    }
+
+    auto arg_bytes = std::vector<std::byte>{};
+    for (const auto& [arg, param] : std::views::zip(args, func.param_types)) {
+        const auto [type, value] = type_of_expr(com, *arg);
+        if (type.remove_const() != param.remove_const() || !append_const_value(arg_bytes, value)) {
+            return std::nullopt;
+        }
+    }
+
+    const auto result = try_evaluate_call(com, func.id, arg_bytes, return_size);
+    if (!result) return std::nullopt;
+    return push_const_bytes(com, return_type, *result);
+}
+
+// Pushes the pointer operand of an @atomic_* intrinsic and returns the pointed-to type
+auto push_atomic_ptr(compiler& com, const token& tok, const node_expr& expr, bool writes) -> type_name
+{
+    const auto type = push_expr(com, compile_type::val, expr).type;
+    tok.assert(type.is<type_ptr>(), "atomic operations require a pointer, got {}", type);
+    const auto inner = type.remove_ptr();
+    tok.assert(!writes || !inner.is_const, "cannot atomically write through a const pointer");
+    const auto value_type = inner.remove_const();
+    tok.assert(value_type.is<type_i64>() || value_type.is<type_u64>(), "atomic operations only support i64 and u64, got {}", value_type);
+    return value_type;
+}
+
 auto compile_struct_template(
     compiler& com,
     const token& tok,
@@ -666,11 +1211,17 @@ auto push_name_pack(
             if (type.is<type_struct>()) {
                 const auto fields = com.types.fields_of(type.as<type_struct>());
                 tok.assert_eq(names.size(), fields.size(), "invalid number of args to unpack struct {} into", type);
+                const auto& sname = type.as<type_struct>();
+                auto size = std::size_t{0};
                 for (const auto& [name, field] : std::views::zip(names, fields)) {
                     auto field_type = field.type;
                     field_type.is_const = type.is_const;
+                    const auto offset = *com.types.offset_of(sname, field.name);
+                    variables(com).skip(offset - size); // padding
                     push_name_pack(com, tok, name, field.type);
+                    size = offset + com.types.size_of(field.type);
                 }
+                variables(com).skip(com.types.size_of(type) - size);
             }
             else if (type.is<type_array>()) {
                 const auto size = type.as<type_array>().count;
@@ -688,6 +1239,20 @@ auto push_name_pack(
     }, np.names);
 }
 
+auto push_expr(compiler& com, compile_type ct, const node_literal_i8_expr& node) -> expr_result
+{
+    node.token.assert(ct == compile_type::val, "cannot take the address of an i8 literal");
+    push_value(code(com), op::push_i8, node.value);
+    return { type_i8{}, node.value };
+}
+
+auto push_expr(compiler& com, compile_type ct, const node_literal_i16_expr& node) -> expr_result
+{
+    node.token.assert(ct == compile_type::val, "cannot take the address of an i16 literal");
+    push_value(code(com), op::push_i16, node.value);
+    return { type_i16{}, node.value };
+}
+
 auto push_expr(compiler& com, compile_type ct, const node_literal_i32_expr& node) -> expr_result
 {
     node.token.assert(ct == compile_type::val, "cannot take the address of a i32 literal");
@@ -702,6 +1267,27 @@ auto push_expr(compiler& com, compile_type ct, const node_literal_i64_expr& node
     return { type_i64{}, node.value };
 }
 
+auto push_expr(compiler& com, compile_type ct, const node_literal_u8_expr& node) -> expr_result
+{
+    node.token.assert(ct == compile_type::val, "cannot take the address of a u8 literal");
+    push_value(code(com), op::push_u8, node.value);
+    return { type_u8{}, node.value };
+}
+
+auto push_expr(compiler& com, compile_type ct, const node_literal_u16_expr& node) -> expr_result
+{
+    node.token.assert(ct == compile_type::val, "cannot take the address of a u16 literal");
+    push_value(code(com), op::push_u16, node.value);
+    return { type_u16{}, node.value };
+}
+
+auto push_expr(compiler& com, compile_type ct, const node_literal_u32_expr& node) -> expr_result
+{
+    node.token.assert(ct == compile_type::val, "cannot take the address of a u32 literal");
+    push_value(code(com), op::push_u32, node.value);
+    return { type_u32{}, node.value };
+}
+
 auto push_expr(compiler& com, compile_type ct, const node_literal_u64_expr& node) -> expr_result
 {
     node.token.assert(ct == compile_type::val, "cannot take the address of a u64 literal");
@@ -709,6 +1295,13 @@ auto push_expr(compiler& com, compile_type ct, const node_literal_u64_expr& node
     return { type_u64{}, node.value };
 }
 
+auto push_expr(compiler& com, compile_type ct, const node_literal_f32_expr& node) -> expr_result
+{
+    node.token.assert(ct == compile_type::val, "cannot take the address of a f32 literal");
+    push_value(code(com), op::push_f32, node.value);
+    return { type_f32{}, node.value };
+}
+
 auto push_expr(compiler& com, compile_type ct, const node_literal_f64_expr& node) -> expr_result
 {
     node.token.assert(ct == compile_type::val, "cannot take the address of a f64 literal");
@@ -748,26 +1341,248 @@ auto push_expr(compiler& com, compile_type ct, const node_literal_string_expr& n
     return { string_literal_type() }; // TODO: Maybe support string literals at compile time?
 }
 
-// TODO: collapse compile-time values if possible
+// Narrow numeric types have no arithmetic ops of their own. Values are widened to the 64 bit
+// type of the same kind, operated on and then narrowed back, which gives the same results.
+struct promotion
+{
+    type_name wide_type;
+    op        widen;
+    op        narrow;
+};
+
+auto get_promotion(const type_name& type) -> std::optional<promotion>
+{
+    if (type.is<type_i8>())  return promotion{type_i64{}, op::i8_to_i64,  op::i64_to_i8};
+    if (type.is<type_i16>()) return promotion{type_i64{}, op::i16_to_i64, op::i64_to_i16};
+    if (type.is<type_u8>())  return promotion{type_u64{}, op::u8_to_u64,  op::u64_to_u8};
+    if (type.is<type_u16>()) return promotion{type_u64{}, op::u16_to_u64, op::u64_to_u16};
+    if (type.is<type_u32>()) return promotion{type_u64{}, op::u32_to_u64, op::u64_to_u32};
+    if (type.is<type_f32>()) return promotion{type_f64{}, op::f32_to_f64, op::f64_to_f32};
+    return std::nullopt;
+}
+
+// Like get_promotion but also widens i32, which has arithmetic ops of its own but shares the
+// 64 bit versions of the bitwise and math ops
+auto get_full_promotion(const type_name& type) -> std::optional<promotion>
+{
+    if (type.is<type_i32>()) return promotion{type_i64{}, op::i32_to_i64, op::i64_to_i32};
+    return get_promotion(type);
+}
+
+auto is_bitwise_op(token_type tt) -> bool
+{
+    switch (tt) {
+        case token_type::ampersand:
+        case token_type::bar:
+        case token_type::caret:
+        case token_type::tilde:
+        case token_type::less_less:
+        case token_type::greater_greater:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Evaluates a unary op on a value known at compile time the same way the runtime would,
+// returning an empty value if it cannot be folded
+auto fold_unary_op(token_type op_type, const const_value& value) -> const_value
+{
+    return std::visit([&] <typename T> (const T& v) -> const_value {
+        if constexpr (std::is_same_v<T, bool>) {
+            if (op_type == token_type::bang) return !v;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            if (op_type == token_type::minus) return static_cast<T>(-v);
+        } else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, char>) {
+            const auto wide = static_cast<std::uint64_t>(v);
+            if (op_type == token_type::minus) return static_cast<T>(0 - wide);
+            if (op_type == token_type::tilde) return static_cast<T>(~wide);
+        }
+        return {};
+    }, value);
+}
+
+// Integer arithmetic wraps and shift amounts are masked, matching the runtime ops. Division
+// by zero and overflowing division are left for the runtime.
+template <typename T>
+auto fold_binary_values(token_type op_type, T lhs, T rhs) -> const_value
+{
+    using tt = token_type;
+    switch (op_type) {
+        case tt::equal_equal:   return lhs == rhs;
+        case tt::bang_equal:    return lhs != rhs;
+        case tt::less:          return lhs < rhs;
+        case tt::less_equal:    return lhs <= rhs;
+        case tt::greater:       return lhs > rhs;
+        case tt::greater_equal: return lhs >= rhs;
+        default: break;
+    }
+    if constexpr (std::is_floating_point_v<T>) {
+        const auto l = static_cast<double>(lhs);
+        const auto r = static_cast<double>(rhs);
+        switch (op_type) {
+            case tt::plus:  return static_cast<T>(l + r);
+            case tt::minus: return static_cast<T>(l - r);
+            case tt::star:  return static_cast<T>(l * r);
+            case tt::slash: return static_cast<T>(l / r);
+            default: break;
+        }
+    } else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>) {
+        const auto l = static_cast<std::uint64_t>(lhs);
+        const auto r = static_cast<std::uint64_t>(rhs);
+        switch (op_type) {
+            case tt::plus:      return static_cast<T>(l + r);
+            case tt::minus:     return static_cast<T>(l - r);
+            case tt::star:      return static_cast<T>(l * r);
+            case tt::ampersand: return static_cast<T>(l & r);
+            case tt::bar:       return static_cast<T>(l | r);
+            case tt::caret:     return static_cast<T>(l ^ r);
+            case tt::less_less: return static_cast<T>(l << (r & 63));
+            case tt::greater_greater: {
+                if constexpr (std::is_signed_v<T>) {
+                    return static_cast<T>(static_cast<std::int64_t>(lhs) >> (r & 63));
+                }
+                return static_cast<T>(l >> (r & 63));
+            }
+            case tt::slash:
+            case tt::percent: {
+                if (rhs == 0) return {};
+                if constexpr (std::is_signed_v<T>) {
+                    if (lhs == std::numeric_limits<T>::min() && rhs == -1) return {};
+                }
+                return static_cast<T>(op_type == tt::slash ? lhs / rhs : lhs % rhs);
+            }
+            default: break;
+        }
+    }
+    return {};
+}
+
+// Evaluates a binary op on two values known at compile time the same way the runtime would,
+// returning an empty value if it cannot be folded. The op must be valid for the types.
+auto fold_binary_op(token_type op_type, const const_value& lhs, const const_value& rhs) -> const_value
+{
+    if (lhs.index() != rhs.index()) return {};
+    return std::visit([&] <typename T> (const T& l) -> const_value {
+        if constexpr (std::is_arithmetic_v<T>) {
+            return fold_binary_values(op_type, l, rhs.as<T>());
+        }
+        return {};
+    }, lhs);
+}
+
+// Converts a value known at compile time the same way the runtime conversion ops would, by
+// going through the 64 bit type of the same kind. Returns an empty value for conversions
+// that cannot be folded, such as floats that do not fit in the destination.
+auto fold_conversion(const const_value& value, const type_name& dst_type) -> const_value
+{
+    const auto convert = [&] <typename Dst> () -> const_value {
+        using wide_dst = std::conditional_t<std::is_floating_point_v<Dst>, double,
+                         std::conditional_t<std::is_signed_v<Dst>, std::int64_t, std::uint64_t>>;
+        return std::visit([&] <typename Src> (const Src& src) -> const_value {
+            if constexpr (std::is_same_v<Src, std::monostate>) {
+                return std::is_same_v<Dst, std::int64_t> || std::is_same_v<Dst, std::uint64_t> ? const_value{Dst{0}} : const_value{};
+            } else if constexpr (std::is_arithmetic_v<Src>) {
+                if constexpr (std::is_floating_point_v<Src> && !std::is_floating_point_v<wide_dst>) {
+                    const auto wide = static_cast<double>(src);
+                    const auto min = static_cast<double>(std::numeric_limits<wide_dst>::min());
+                    const auto max = static_cast<double>(std::numeric_limits<wide_dst>::max());
+                    if (!(wide >= min && wide < max)) return {};
+                }
+                using wide_src = std::conditional_t<std::is_floating_point_v<Src>, double,
+                                 std::conditional_t<std::is_signed_v<Src>, std::int64_t, std::uint64_t>>;
+                return static_cast<Dst>(static_cast<wide_dst>(static_cast<wide_src>(src)));
+            }
+            return {};
+        }, value);
+    };
+
+    if (dst_type.is<type_i8>())  return convert.operator()<std::int8_t>();
+    if (dst_type.is<type_i16>()) return convert.operator()<std::int16_t>();
+    if (dst_type.is<type_i32>()) return convert.operator()<std::int32_t>();
+    if (dst_type.is<type_i64>()) return convert.operator()<std::int64_t>();
+    if (dst_type.is<type_u8>())  return convert.operator()<std::uint8_t>();
+    if (dst_type.is<type_u16>()) return convert.operator()<std::uint16_t>();
+    if (dst_type.is<type_u32>()) return convert.operator()<std::uint32_t>();
+    if (dst_type.is<type_u64>()) return convert.operator()<std::uint64_t>();
+    if (dst_type.is<type_f32>()) return convert.operator()<float>();
+    if (dst_type.is<type_f64>()) return convert.operator()<double>();
+    return {};
+}
+
 auto push_expr(compiler& com, compile_type ct, const node_unary_op_expr& node) -> expr_result
 {
     node.token.assert(ct == compile_type::val, "cannot take the address of a unary op");
     using tt = token_type;
-    const auto type = push_expr(com, compile_type::val, *node.expr).type;
+    const auto begin = code(com).size();
+    const auto [type, value] = push_expr(com, compile_type::val, *node.expr);
+
+    // An operand known at compile time is replaced with a push of the result
+    const auto folded = [&] -> expr_result {
+        if (const auto result = fold_unary_op(node.token.type, value); result.has_value()) {
+            code(com).resize(begin);
+            return push_const_value(com, type, result);
+        }
+        return { type };
+    };
 
     switch (node.token.type) {
         case tt::minus: {
-            if (type.is<type_i32>()) { push_value(code(com), op::i32_neg); return { type }; }
-            if (type.is<type_i64>()) { push_value(code(com), op::i64_neg); return { type }; }
-            if (type.is<type_f64>()) { push_value(code(com), op::f64_neg); return { type }; }
+            if (type.is<type_i32>()) { push_value(code(com), op::i32_neg); return folded(); }
+            if (type.is<type_i64>()) { push_value(code(com), op::i64_neg); return folded(); }
+            if (type.is<type_f64>()) { push_value(code(com), op::f64_neg); return folded(); }
+            if (type.is<type_i8>() || type.is<type_i16>() || type.is<type_f32>()) {
+                const auto [wide_type, widen, narrow] = *get_promotion(type);
+                const auto neg = wide_type.is<type_f64>() ? op::f64_neg : op::i64_neg;
+                push_value(code(com), widen, neg, narrow);
+                return folded();
+            }
         } break;
         case tt::bang: {
-            if (type.is<type_bool>()) { push_value(code(com), op::bool_not); return { type }; }
+            if (type.is<type_bool>()) { push_value(code(com), op::bool_not); return folded(); }
+        } break;
+        case tt::tilde: {
+            if (type.is<type_i64>() || type.is<type_u64>()) { push_value(code(com), op::u64_not); return folded(); }
+            if (const auto promoted = get_full_promotion(type); promoted && !type.is<type_f32>()) {
+                push_value(code(com), promoted->widen, op::u64_not, promoted->narrow);
+                return folded();
+            }
         } break;
     }
     node.token.error("[1] could not find op '{}{}'", node.token.type, type);
 }
 
+// Returns the version of the given i64 or u64 op that takes its right hand side as an
+// immediate operand, if there is one
+auto immediate_op(op op_code) -> std::optional<op>
+{
+    switch (op_code) {
+        case op::i64_add: return op::i64_add_imm;
+        case op::i64_sub: return op::i64_sub_imm;
+        case op::i64_mul: return op::i64_mul_imm;
+        case op::i64_div: return op::i64_div_imm;
+        case op::i64_mod: return op::i64_mod_imm;
+        case op::i64_eq:  return op::i64_eq_imm;
+        case op::i64_ne:  return op::i64_ne_imm;
+        case op::i64_lt:  return op::i64_lt_imm;
+        case op::i64_le:  return op::i64_le_imm;
+        case op::i64_gt:  return op::i64_gt_imm;
+        case op::i64_ge:  return op::i64_ge_imm;
+        case op::u64_add: return op::u64_add_imm;
+        case op::u64_sub: return op::u64_sub_imm;
+        case op::u64_mul: return op::u64_mul_imm;
+        case op::u64_div: return op::u64_div_imm;
+        case op::u64_mod: return op::u64_mod_imm;
+        case op::u64_eq:  return op::u64_eq_imm;
+        case op::u64_ne:  return op::u64_ne_imm;
+        case op::u64_lt:  return op::u64_lt_imm;
+        case op::u64_le:  return op::u64_le_imm;
+        case op::u64_gt:  return op::u64_gt_imm;
+        case op::u64_ge:  return op::u64_ge_imm;
+        default: return std::nullopt;
+    }
+}
+
 auto push_expr(compiler& com, compile_type ct, const node_binary_op_expr& node) -> expr_result
 {
     node.token.assert(ct == compile_type::val, "cannot take the address of a binary op");
@@ -775,12 +1590,6 @@ auto push_expr(compiler& com, compile_type ct, const node_binary_op_expr& node)
     auto [lhs, lhs_value] = type_of_expr(com, *node.lhs);
     auto [rhs, rhs_value] = type_of_expr(com, *node.rhs);
 
-    const auto push = [&] (anzu::op op_code) {
-        push_expr(com, compile_type::val, *node.lhs);
-        push_expr(com, compile_type::val, *node.rhs);
-        push_value(code(com), op_code);
-    };
-
     const auto push_ptr = [&] (const node_expr& expr) {
         if (type_of_expr(com, expr).type.is<type_null>()) {
             push_value(code(com), op::push_u64, std::size_t{0});
@@ -835,82 +1644,127 @@ auto push_expr(compiler& com, compile_type ct, const node_binary_op_expr& node)
     }
 
     if (lhs != rhs) node.token.error("[5] could not find op '{} {} {}'", lhs, node.token.type, rhs);
-    const auto& type = lhs;
+    const auto promoted = is_bitwise_op(node.token.type) ? get_full_promotion(lhs) : get_promotion(lhs);
+    const auto& type = promoted ? promoted->wide_type : lhs;
+
+    const auto push = [&] (anzu::op op_code, const type_name& result) -> expr_result {
+        // Both sides known at compile time, so only the result needs pushing
+        if (const auto value = fold_binary_op(node.token.type, lhs_value, rhs_value); value.has_value()) {
+            return push_const_value(com, result.is<type_bool>() ? result : lhs, value);
+        }
+
+        push_expr(com, compile_type::val, *node.lhs);
+        if (promoted) push_value(code(com), promoted->widen);
+
+        // A right hand side known at compile time is written into the op instead
+        const auto imm = immediate_op(op_code);
+        if (imm && rhs_value.is<std::int64_t>()) {
+            push_value(code(com), *imm, rhs_value.as<std::int64_t>());
+            return { result };
+        }
+        if (imm && rhs_value.is<std::uint64_t>()) {
+            push_value(code(com), *imm, rhs_value.as<std::uint64_t>());
+            return { result };
+        }
+
+        push_expr(com, compile_type::val, *node.rhs);
+        if (promoted) push_value(code(com), promoted->widen);
+        push_value(code(com), op_code);
+        if (promoted && !result.is<type_bool>()) {
+            push_value(code(com), promoted->narrow);
+            return { lhs };
+        }
+        return { result };
+    };
 
     if (type.is<type_ptr>()) {
         switch (node.token.type) {
-            case tt::equal_equal: { push(op::u64_eq); return { type_bool{} }; }
-            case tt::bang_equal:  { push(op::u64_ne); return { type_bool{} }; }
+            case tt::equal_equal: return push(op::u64_eq, type_bool{});
+            case tt::bang_equal:  return push(op::u64_ne, type_bool{});
         }
     }
     else if (type.is<type_char>()) {
         switch (node.token.type) {
-            case tt::equal_equal: { push(op::char_eq); return { type_bool{} }; }
-            case tt::bang_equal:  { push(op::char_ne); return { type_bool{} }; }
+            case tt::equal_equal: return push(op::char_eq, type_bool{});
+            case tt::bang_equal:  return push(op::char_ne, type_bool{});
         }
     }
     else if (type.is<type_i32>()) {
         switch (node.token.type) {
-            case tt::plus:          { push(op::i32_add); return { type };       }
-            case tt::minus:         { push(op::i32_sub); return { type };       }
-            case tt::star:          { push(op::i32_mul); return { type };       }
-            case tt::slash:         { push(op::i32_div); return { type };       }
-            case tt::percent:       { push(op::i32_mod); return { type };       }
-            case tt::equal_equal:   { push(op::i32_eq); return { type_bool{} }; }
-            case tt::bang_equal:    { push(op::i32_ne); return { type_bool{} }; }
-            case tt::less:          { push(op::i32_lt); return { type_bool{} }; }
-            case tt::less_equal:    { push(op::i32_le); return { type_bool{} }; }
-            case tt::greater:       { push(op::i32_gt); return { type_bool{} }; }
-            case tt::greater_equal: { push(op::i32_ge); return { type_bool{} }; }
+            case tt::plus:          return push(op::i32_add, type);
+            case tt::minus:         return push(op::i32_sub, type);
+            case tt::star:          return push(op::i32_mul, type);
+            case tt::slash:         return push(op::i32_div, type);
+            case tt::percent:       return push(op::i32_mod, type);
+            case tt::equal_equal:   return push(op::i32_eq, type_bool{});
+            case tt::bang_equal:    return push(op::i32_ne, type_bool{});
+            case tt::less:          return push(op::i32_lt, type_bool{});
+            case tt::less_equal:    return push(op::i32_le, type_bool{});
+            case tt::greater:       return push(op::i32_gt, type_bool{});
+            case tt::greater_equal: return push(op::i32_ge, type_bool{});
         }
     }
     else if (type.is<type_i64>()) {
         switch (node.token.type) {
-            case tt::plus:          { push(op::i64_add); return { type };       }
-            case tt::minus:         { push(op::i64_sub); return { type };       }
-            case tt::star:          { push(op::i64_mul); return { type };       }
-            case tt::slash:         { push(op::i64_div); return { type };       }
-            case tt::percent:       { push(op::i64_mod); return { type };       }
-            case tt::equal_equal:   { push(op::i64_eq); return { type_bool{} }; }
-            case tt::bang_equal:    { push(op::i64_ne); return { type_bool{} }; }
-            case tt::less:          { push(op::i64_lt); return { type_bool{} }; }
-            case tt::less_equal:    { push(op::i64_le); return { type_bool{} }; }
-            case tt::greater:       { push(op::i64_gt); return { type_bool{} }; }
-            case tt::greater_equal: { push(op::i64_ge); return { type_bool{} }; }
+            case tt::plus:          return push(op::i64_add, type);
+            case tt::minus:         return push(op::i64_sub, type);
+            case tt::star:          return push(op::i64_mul, type);
+            case tt::slash:         return push(op::i64_div, type);
+            case tt::percent:       return push(op::i64_mod, type);
+            case tt::equal_equal:   return push(op::i64_eq, type_bool{});
+            case tt::bang_equal:    return push(op::i64_ne, type_bool{});
+            case tt::less:          return push(op::i64_lt, type_bool{});
+            case tt::less_equal:    return push(op::i64_le, type_bool{});
+            case tt::greater:       return push(op::i64_gt, type_bool{});
+            case tt::greater_equal: return push(op::i64_ge, type_bool{});
+            case tt::ampersand:       return push(op::u64_and, type);
+            case tt::bar:             return push(op::u64_or, type);
+            case tt::caret:           return push(op::u64_xor, type);
+            case tt::less_less:       return push(op::u64_shl, type);
+            case tt::greater_greater: return push(op::i64_shr, type);
         }
     }
     else if (type.is<type_u64>()) {
         switch (node.token.type) {
-            case tt::plus:          { push(op::u64_add); return { type };       }
-            case tt::minus:         { push(op::u64_sub); return { type };       }
-            case tt::star:          { push(op::u64_mul); return { type };       }
-            case tt::slash:         { push(op::u64_div); return { type };       }
-            case tt::percent:       { push(op::u64_mod); return { type };       }
-            case tt::equal_equal:   { push(op::u64_eq); return { type_bool{} }; }
-            case tt::bang_equal:    { push(op::u64_ne); return { type_bool{} }; }
-            case tt::less:          { push(op::u64_lt); return { type_bool{} }; }
-            case tt::less_equal:    { push(op::u64_le); return { type_bool{} }; }
-            case tt::greater:       { push(op::u64_gt); return { type_bool{} }; }
-            case tt::greater_equal: { push(op::u64_ge); return { type_bool{} }; }
+            case tt::plus:          return push(op::u64_add, type);
+            case tt::minus:         return push(op::u64_sub, type);
+            case tt::star:          return push(op::u64_mul, type);
+            case tt::slash:         return push(op::u64_div, type);
+            case tt::percent:       return push(op::u64_mod, type);
+            case tt::equal_equal:   return push(op::u64_eq, type_bool{});
+            case tt::bang_equal:    return push(op::u64_ne, type_bool{});
+            case tt::less:          return push(op::u64_lt, type_bool{});
+            case tt::less_equal:    return push(op::u64_le, type_bool{});
+            case tt::greater:       return push(op::u64_gt, type_bool{});
+            case tt::greater_equal: return push(op::u64_ge, type_bool{});
+            case tt::ampersand:       return push(op::u64_and, type);
+            case tt::bar:             return push(op::u64_or, type);
+            case tt::caret:           return push(op::u64_xor, type);
+            case tt::less_less:       return push(op::u64_shl, type);
+            case tt::greater_greater: return push(op::u64_shr, type);
         }
     }
     else if (type.is<type_f64>()) {
         switch (node.token.type) {
-            case tt::plus:          { push(op::f64_add); return { type };       }
-            case tt::minus:         { push(op::f64_sub); return { type };       }
-            case tt::star:          { push(op::f64_mul); return { type };       }
-            case tt::slash:         { push(op::f64_div); return { type };       }
-            case tt::equal_equal:   { push(op::f64_eq); return { type_bool{} }; }
-            case tt::bang_equal:    { push(op::f64_ne); return { type_bool{} }; }
-            case tt::less:          { push(op::f64_lt); return { type_bool{} }; }
-            case tt::less_equal:    { push(op::f64_le); return { type_bool{} }; }
-            case tt::greater:       { push(op::f64_gt); return { type_bool{} }; }
-            case tt::greater_equal: { push(op::f64_ge); return { type_bool{} }; }
+            case tt::plus:          return push(op::f64_add, type);
+            case tt::minus:         return push(op::f64_sub, type);
+            case tt::star:          return push(op::f64_mul, type);
+            case tt::slash:         return push(op::f64_div, type);
+            case tt::equal_equal:   return push(op::f64_eq, type_bool{});
+            case tt::bang_equal:    return push(op::f64_ne, type_bool{});
+            case tt::less:          return push(op::f64_lt, type_bool{});
+            case tt::less_equal:    return push(op::f64_le, type_bool{});
+            case tt::greater:       return push(op::f64_gt, type_bool{});
+            case tt::greater_equal: return push(op::f64_ge, type_bool{});
         }
     }
     else if (type.is<type_bool>()) {
         switch (node.token.type) {
             case tt::ampersand_ampersand: {
+                if (lhs_value.is<bool>()) { // the rhs is only evaluated if the lhs is true
+                    if (!lhs_value.as<bool>()) return push_const_value(com, type, false);
+                    return { type, push_expr(com, compile_type::val, *node.rhs).value };
+                }
                 push_expr(com, compile_type::val, *node.lhs);
                 push_value(code(com), op::jump_if_false);
                 const auto jump_pos = push_value(code(com), std::size_t{0});
@@ -923,6 +1777,10 @@ auto push_expr(compiler& com, compile_type ct, const node_binary_op_expr& node)
                 return { type };
             }
             case tt::bar_bar: {
+                if (lhs_value.is<bool>()) { // the rhs is only evaluated if the lhs is false
+                    if (lhs_value.as<bool>()) return push_const_value(com, type, true);
+                    return { type, push_expr(com, compile_type::val, *node.rhs).value };
+                }
                 push_expr(com, compile_type::val, *node.lhs);
                 push_value(code(com), op::jump_if_true);
                 const auto jump_pos = push_value(code(com), std::size_t{0});
@@ -934,8 +1792,8 @@ auto push_expr(compiler& com, compile_type ct, const node_binary_op_expr& node)
                 write_value(code(com), jump_pos2, code(com).size());
                 return { type };
             }
-            case tt::equal_equal: { push(op::bool_eq); return { type }; }
-            case tt::bang_equal:  { push(op::bool_ne); return { type }; }
+            case tt::equal_equal: return push(op::bool_eq, type);
+            case tt::bang_equal:  return push(op::bool_ne, type);
         }
     }
 
@@ -949,10 +1807,10 @@ auto push_expr(compiler& com, compile_type ct, const node_call_expr& node) -> ex
 
     if (auto info = type.get_if<type_type>()) { // constructor
         const auto inner = get_type_value(node.token, {type, value});
-        if (node.args.empty()) { // default constructor
-            push_value(code(com), op::push, com.types.size_of(inner));
+        if (node.args.empty()) { // default constructor, zeroed so that @compare sees no stale padding
+            push_value(code(com), op::push_zero, com.types.size_of(inner));
         } else {
-            push_args_typechecked(com, node.token, node.args, constructor_params(com, inner));
+            push_constructor_args(com, node.token, node.args, inner);
         }
         return { inner };
     }
@@ -966,20 +1824,30 @@ auto push_expr(compiler& com, compile_type ct, const node_call_expr& node) -> ex
         if (!com.types.contains(name)) {
             compile_struct_template(com, node.token, name, ast);
         }
-        push_args_typechecked(com, node.token, node.args, constructor_params(com, name));
+        push_constructor_args(com, node.token, node.args, name);
         return { name };
     }
     else if (auto info = type.get_if<type_function_ptr>()) {
         const auto args_size = push_args_typechecked(com, node.token, node.args, info->param_types);
         push_expr(com, compile_type::val, *node.expr);
-        push_value(code(com), op::call_ptr, args_size);
+        const auto return_size = com.types.size_of(*info->return_type);
+        push_value(code(com), op::call_ptr, args_size, return_size);
         return { *info->return_type };
     }
     else if (auto info = type.get_if<type_function>()) {
+        if (const auto result = push_constant_call(com, node.args, *info)) {
+            return *result;
+        }
         const auto args_size = push_args_typechecked(com, node.token, node.args, info->param_types);
         push_value(code(com), op::call_static, info->id, args_size);
         return { *info->return_type };
     }
+    else if (auto info = type.get_if<type_native_function>()) {
+        const auto args_size = push_args_typechecked(com, node.token, node.args, info->param_types);
+        const auto return_size = com.types.size_of(*info->return_type);
+        push_value(code(com), op::call_native, info->id, args_size, return_size);
+        return { *info->return_type };
+    }
     else if (auto info = type.get_if<type_function_template>()) {
         const auto& ast = com.function_templates[*info];
         const auto params = ast.params
@@ -988,7 +1856,10 @@ auto push_expr(compiler& com, compile_type ct, const node_call_expr& node) -> ex
         const auto templates = deduce_template_params(com, node.token, ast.templates, params, node.args);
         const auto name = function_name{ info->module, info->struct_name, info->name, templates };
         const auto func = fetch_function(com, node.token, name);
-        
+        if (const auto result = push_constant_call(com, node.args, func)) {
+            return *result;
+        }
+
         const auto args_size = push_args_typechecked(com, node.token, node.args, func.param_types);
         push_value(code(com), op::call_static, func.id, args_size);
         return { *func.return_type };
@@ -1061,12 +1932,14 @@ auto push_expr(compiler& com, compile_type ct, const node_array_expr& node) -> e
     node.token.assert(ct == compile_type::val, "cannot take the address of an array expression");
     node.token.assert(!node.elements.empty(), "cannot have empty array literals");
 
+    const auto begin = code(com).size();
     const auto inner_type = push_expr(com, compile_type::val, *node.elements.front()).type;
     node.token.assert(!inner_type.is<type_type>(), "invalid use of type expressions");
     for (const auto& element : node.elements | std::views::drop(1)) {
         const auto element_type = push_expr(com, compile_type::val, *element).type;
         node.token.assert_eq(element_type, inner_type, "array has mismatching element types");
     }
+    fold_constant_pushes(com, begin);
     return { inner_type.add_array(node.elements.size()) };
 }
 
@@ -1075,11 +1948,13 @@ auto push_expr(compiler& com, compile_type ct, const node_repeat_array_expr& nod
     node.token.assert(ct == compile_type::val, "cannot take the address of a repeat array expression");
     node.token.assert(node.size != 0, "cannot have empty array literals");
 
+    const auto begin = code(com).size();
     const auto inner_type = type_of_expr(com, *node.value).type;
     node.token.assert(!inner_type.is<type_type>(), "invalid use of type expressions");
     for (std::size_t i = 0; i != node.size; ++i) {
         push_expr(com, compile_type::val, *node.value);
     }
+    fold_constant_pushes(com, begin);
     return { inner_type.add_array(node.size) };
 }
 
@@ -1133,7 +2008,7 @@ auto push_expr(compiler& com,compile_type ct, const node_span_expr& node) -> exp
     // If we are a span, we want the address that it holds rather than its own address,
     // so switch the pointer by loading what it's pointing at.
     if (type.is<type_span>()) {
-        push_value(code(com), op::load, sizeof(std::byte*));
+        push_load(com, sizeof(std::byte*));
     }
 
     // next push the size to make up the second half of the span
@@ -1147,7 +2022,7 @@ auto push_expr(compiler& com,compile_type ct, const node_span_expr& node) -> exp
         // Push the span pointer, offset to the size, and load the size
         push_expr(com, compile_type::ptr, *node.expr);
         push_value(code(com), op::push_u64, sizeof(std::byte*), op::u64_add);
-        push_value(code(com), op::load, com.types.size_of(type_u64{}));
+        push_load(com, com.types.size_of(type_u64{}));
     } else {
         push_value(code(com), op::push_u64, type.as<type_array>().count);
     }
@@ -1241,6 +2116,7 @@ auto push_expr(compiler& com, compile_type ct, const node_new_expr& node) -> exp
 //  - a type alias for the current function template
 //  - a type alias for the current struct template
 //  - a function
+//  - a native function
 //  - a placeholder
 //  - a variable
 void push_stmt(compiler& com, const node_function_stmt& stmt);
@@ -1254,6 +2130,13 @@ auto push_expr(compiler& com, compile_type ct, const node_name_expr& node) -> ex
         return { type_function{func.id, func.params, func.return_type} };
     }
 
+    // It might be a native function provided by the host
+    if (const auto it = com.natives_by_name.find(node.name); it != com.natives_by_name.end()) {
+        node.token.assert(ct == compile_type::val, "cannot take the address of a native function");
+        const auto& native = com.natives[it->second];
+        return { type_native_function{it->second, native.param_types, native.return_type} };
+    }
+
     // It might be a function template
     if (com.function_templates.contains(fname.as_template())) {
         node.token.assert(ct == compile_type::val, "cannot take the address of a function template");
@@ -1421,7 +2304,7 @@ auto push_expr(compiler& com, compile_type ct, const node_field_expr& node) -> e
     auto field_type = push_field_offset(com, node.token, struct_name, node.name);
     push_value(code(com), op::u64_add); // modify ptr
     if (ct == compile_type::val) {
-        push_value(code(com), op::load, com.types.size_of(field_type));
+        push_load(com, com.types.size_of(field_type));
     }
     
     if (stripped.is_const) field_type.is_const = true; // propagate const to fields
@@ -1433,7 +2316,7 @@ auto push_expr(compiler& com, compile_type ct, const node_deref_expr& node) -> e
     const auto type = push_expr(com, compile_type::val, *node.expr).type; // Push the address
     node.token.assert(type.is<type_ptr>(), "cannot use deref operator on non-ptr type '{}'", type);
     if (ct == compile_type::val) {
-        push_value(code(com), op::load, com.types.size_of(type.remove_ptr()));
+        push_load(com, com.types.size_of(type.remove_ptr()));
     }
     return { type.remove_ptr() };
 }
@@ -1445,6 +2328,12 @@ auto push_expr(compiler& com, compile_type ct, const node_subscript_expr& node)
         const auto size_result = type_of_expr(com, *node.index);
         const auto typeval = get_type_value(node.token, {type, value});
         const auto size = get_u64_value(node.token, size_result);
+
+        // Object sizes are encoded as 32 bit operands
+        constexpr auto max_size = std::numeric_limits<bytecode_operand>::max();
+        const auto element_size = com.types.size_of(typeval);
+        node.token.assert(element_size == 0 || size <= max_size / element_size,
+                          "array type {}[{}] is larger than the limit of {} bytes", typeval, size, max_size);
         return { type_type{}, {typeval.add_array(size)}};
     }
 
@@ -1459,7 +2348,7 @@ auto push_expr(compiler& com, compile_type ct, const node_subscript_expr& node)
     // If we are a span, we want the address that it holds rather than its own address,
     // so switch the pointer by loading what it's pointing at.
     if (is_span) {
-        push_value(code(com), op::load, sizeof(std::byte*));
+        push_load(com, sizeof(std::byte*));
     }
 
     // Offset pointer by (index * size)
@@ -1486,9 +2375,17 @@ auto push_expr(compiler& com, compile_type ct, const node_ternary_expr& node) ->
     const auto type = type_of_expr(com, *node.true_case).type;
     node.token.assert_eq(type_of_expr(com, *node.false_case).type, type, "mismatched types in ternary");
 
-    const auto cond_type = push_expr(com, compile_type::val, *node.condition).type;
+    const auto begin = code(com).size();
+    const auto [cond_type, cond_value] = push_expr(com, compile_type::val, *node.condition);
     node.token.assert_eq(cond_type, type_name{type_bool{}}, "if-stmt invalid condition");
 
+    // Only the taken branch is compiled if the condition is known at compile time
+    if (cond_value.is<bool>()) {
+        code(com).resize(begin);
+        const auto& branch = cond_value.as<bool>() ? *node.true_case : *node.false_case;
+        return { type, push_expr(com, ct, branch).value };
+    }
+
     push_value(code(com), op::jump_if_false);
     const auto jump_pos = push_value(code(com), std::uint64_t{0});
     push_expr(com, ct, *node.true_case);
@@ -1501,6 +2398,112 @@ auto push_expr(compiler& com, compile_type ct, const node_ternary_expr& node) ->
     return { type };
 }
 
+// Math intrinsics are computed in f64, so f32 arguments are widened and the result narrowed
+auto push_float_intrinsic(compiler& com, const node_intrinsic_expr& node, op op_code, std::size_t num_args) -> expr_result
+{
+    node.token.assert_eq(node.args.size(), num_args, "incorrect number of arguments for @{}", node.name);
+    const auto type = type_of_expr(com, *node.args[0]).type.remove_const();
+    node.token.assert(type.is<type_f64>() || type.is<type_f32>(), "@{} requires an f64 or f32, got {}", node.name, type);
+    const auto promoted = get_promotion(type);
+    for (const auto& arg : node.args) {
+        push_copy_typechecked(com, *arg, type, node.token);
+        if (promoted) push_value(code(com), promoted->widen);
+    }
+    push_value(code(com), op_code);
+    if (promoted) push_value(code(com), promoted->narrow);
+    return { type };
+}
+
+// @min, @max and @abs work on every numeric type by widening to the 64 bit type of the same kind
+auto push_numeric_intrinsic(compiler& com, const node_intrinsic_expr& node) -> expr_result
+{
+    const auto is_abs = node.name == "abs";
+    node.token.assert_eq(node.args.size(), is_abs ? 1 : 2, "incorrect number of arguments for @{}", node.name);
+    const auto type = type_of_expr(com, *node.args[0]).type.remove_const();
+    const auto promoted = get_full_promotion(type);
+    const auto& wide_type = promoted ? promoted->wide_type : type;
+    for (const auto& arg : node.args) {
+        push_copy_typechecked(com, *arg, type, node.token);
+        if (promoted) push_value(code(com), promoted->widen);
+    }
+
+    if (wide_type.is<type_i64>()) {
+        push_value(code(com), is_abs ? op::i64_abs : node.name == "min" ? op::i64_min : op::i64_max);
+    } else if (wide_type.is<type_u64>()) {
+        if (!is_abs) push_value(code(com), node.name == "min" ? op::u64_min : op::u64_max);
+    } else if (wide_type.is<type_f64>()) {
+        push_value(code(com), is_abs ? op::f64_abs : node.name == "min" ? op::f64_min : op::f64_max);
+    } else {
+        node.token.error("@{} requires a numeric type, got {}", node.name, type);
+    }
+
+    if (promoted) push_value(code(com), promoted->narrow);
+    return { type };
+}
+
+// The struct-of-arrays form of a struct T is a generated struct with the same field names,
+// where each field is a span, so projecting a field gives contiguous storage for that field
+auto get_soa_type(compiler& com, const token& tok, const type_name& inner) -> type_struct
+{
+    tok.assert(inner.is<type_struct>(), "@soa requires a struct type, got {}", inner);
+    const auto& inner_struct = inner.as<type_struct>();
+    const auto fields = com.types.fields_of(inner_struct);
+    tok.assert(!fields.empty(), "cannot create a struct-of-arrays for {} as it has no fields", inner);
+
+    // The name cannot be spelled in source, so this can never clash with a user struct
+    const auto soa = type_struct{ .name="@soa", .module=inner_struct.module, .templates={inner} };
+    if (!com.types.contains(soa)) {
+        com.types.add_type(soa);
+        for (const auto& field : fields) {
+            com.types.add_field(soa, type_field{field.name, field.type.add_span()});
+        }
+    }
+    return soa;
+}
+
+// The @bits_* intrinsics implement std.bitset, taking its words as a u64[] followed by the
+// size of the bitset and an index, or the words of a second bitset for the bulk operations
+auto push_bits_intrinsic(compiler& com, const node_intrinsic_expr& node) -> expr_result
+{
+    const auto words = type_name{type_u64{}}.add_span();
+    const auto const_words = type_name{type_u64{}}.add_const().add_span();
+    const auto push_args = [&](std::initializer_list<type_name> types) {
+        node.token.assert_eq(node.args.size(), types.size(), "wrong number of arguments to @{}", node.name);
+        for (const auto& [arg, type] : std::views::zip(node.args, types)) {
+            push_copy_typechecked(com, *arg, type, node.token);
+        }
+    };
+
+    if (node.name == "bits_set" || node.name == "bits_clear") {
+        push_args({words, type_u64{}, type_u64{}});
+        push_value(code(com), node.name == "bits_set" ? op::bits_set : op::bits_clear);
+        return { type_null{} };
+    }
+    if (node.name == "bits_test") {
+        push_args({const_words, type_u64{}, type_u64{}});
+        push_value(code(com), op::bits_test);
+        return { type_bool{} };
+    }
+    if (node.name == "bits_count") {
+        push_args({const_words});
+        push_value(code(com), op::bits_count);
+        return { type_u64{} };
+    }
+    if (node.name == "bits_find_next") {
+        push_args({const_words, type_u64{}, type_u64{}});
+        push_value(code(com), op::bits_find_next);
+        return { type_u64{} };
+    }
+    if (node.name == "bits_and" || node.name == "bits_or" || node.name == "bits_xor") {
+        push_args({words, const_words});
+        if      (node.name == "bits_and") push_value(code(com), op::bits_and);
+        else if (node.name == "bits_or")  push_value(code(com), op::bits_or);
+        else                              push_value(code(com), op::bits_xor);
+        return { type_null{} };
+    }
+    node.token.error("no intrisic function named @{} exists", node.name);
+}
+
 auto push_expr(compiler& com, compile_type ct, const node_intrinsic_expr& node) -> expr_result
 {
     node.token.assert(ct == compile_type::val, "cannot take the address of a @intrinsic function call");
@@ -1518,7 +2521,7 @@ auto push_expr(compiler& com, compile_type ct, const node_intrinsic_expr& node)
         }
         else if (type.is<type_arena>()) {
             const auto type = push_expr(com, compile_type::ptr, *node.args[0]).type;
-            push_value(code(com), op::load, com.types.size_of(type_u64{})); // load the arena
+            push_load(com, com.types.size_of(type_u64{})); // load the arena
             push_value(code(com), op::arena_size);
             return { type_u64{} };
         }
@@ -1551,6 +2554,25 @@ auto push_expr(compiler& com, compile_type ct, const node_intrinsic_expr& node)
         }
         return { type_u64{} }; // TODO: can return as a compile-time value
     }
+    if (node.name == "align_of") {
+        node.token.assert_eq(node.args.size(), 1, "@align_of only accepts one argument");
+        const auto [type, value] = type_of_expr(com, *node.args[0]);
+        const auto inner = type.is<type_type>() ? get_type_value(node.token, {type, value}) : type;
+        const auto align = com.types.align_of(inner);
+        push_value(code(com), op::push_u64, align);
+        return { type_u64{}, align };
+    }
+    if (node.name == "offset_of") {
+        node.token.assert_eq(node.args.size(), 2, "@offset_of requires a struct type and a field name");
+        const auto type = resolve_type(com, node.token, node.args[0]);
+        node.token.assert(type.is<type_struct>(), "@offset_of requires a struct type, got {}", type);
+        node.token.assert(std::holds_alternative<node_name_expr>(*node.args[1]), "@offset_of requires a field name");
+        const auto& field = std::get<node_name_expr>(*node.args[1]).name;
+        const auto offset = com.types.offset_of(type.as<type_struct>(), field);
+        node.token.assert(offset.has_value(), "could not find field '{}' for type '{}'", field, type);
+        push_value(code(com), op::push_u64, *offset);
+        return { type_u64{}, *offset };
+    }
     if (node.name == "type_of") {
         node.token.assert_eq(node.args.size(), 1, "@type_of only accepts one argument");
         return { type_type{}, {type_of_expr(com, *node.args[0]).type} };
@@ -1610,9 +2632,15 @@ auto push_expr(compiler& com, compile_type ct, const node_intrinsic_expr& node)
             [&](type_null)   { return true;  },
             [&](type_bool)   { return true;  },
             [&](type_char)   { return true;  },
+            [&](type_i8)     { return true;  },
+            [&](type_i16)    { return true;  },
             [&](type_i32)    { return true;  },
             [&](type_i64)    { return true;  },
+            [&](type_u8)     { return true;  },
+            [&](type_u16)    { return true;  },
+            [&](type_u32)    { return true;  },
             [&](type_u64)    { return true;  },
+            [&](type_f32)    { return true;  },
             [&](type_f64)    { return true;  },
             [&](type_arena)  { return true;  },
             [&](type_module) { return true;  },
@@ -1641,19 +2669,185 @@ auto push_expr(compiler& com, compile_type ct, const node_intrinsic_expr& node)
         node.token.assert_eq(file_type, char_span, "incorrect type for file path");
         const auto arena_type = push_expr(com, compile_type::val, *node.args[1]).type;
         node.token.assert_eq(arena_type, arena_ptr, "incorrect type for arena");
-        push_value(code(com), op::load, sizeof(std::byte*)); // load the arena
+        push_load(com, sizeof(std::byte*)); // load the arena
         push_value(code(com), op::read_file);
         return { char_span };
     }
+    if (node.name == "embed_file") {
+        node.token.assert_eq(node.args.size(), 1, "@embed_file only accepts one argument");
+        node.token.assert(std::holds_alternative<node_literal_string_expr>(*node.args[0]), "@embed_file requires a string literal");
+        const auto filepath = std::get<node_literal_string_expr>(*node.args[0]).value;
+        auto it = com.embedded_files.find(filepath);
+        if (it == com.embedded_files.end()) {
+            auto file = std::ifstream{filepath, std::ios::binary}; // keep line endings as they are
+            node.token.assert(file.is_open(), "@embed_file could not open file '{}'", filepath);
+            const auto contents = std::string{std::istreambuf_iterator<char>{file}, {}};
+            const auto location = std::pair{insert_into_rom(com, contents), contents.size()};
+            it = com.embedded_files.emplace(filepath, location).first;
+        }
+        const auto [position, size] = it->second;
+        push_value(code(com), op::push_string_literal, position, size);
+        return { string_literal_type() };
+    }
+    if (node.name == "channel") {
+        node.token.assert_eq(node.args.size(), 1, "@channel only accepts one argument");
+        const auto inner = resolve_type(com, node.token, node.args[0]);
+        return { type_type{}, {type_name{type_channel{ .inner_type = {inner} }}} };
+    }
+    if (node.name == "channel_new") {
+        node.token.assert_eq(node.args.size(), 3, "@channel_new requires a type, a capacity and an arena");
+        const auto inner = resolve_type(com, node.token, node.args[0]);
+        node.token.assert(com.types.size_of(inner) > 0, "cannot create a channel of size zero type {}", inner);
+        const auto capacity_type = push_expr(com, compile_type::val, *node.args[1]).type;
+        node.token.assert_eq(capacity_type, type_name{type_u64{}}, "incorrect type for channel capacity");
+        const auto arena_type = push_expr(com, compile_type::val, *node.args[2]).type;
+        node.token.assert_eq(arena_type, type_name{type_arena{}}.add_ptr(), "incorrect type for arena");
+        push_load(com, sizeof(std::byte*)); // load the arena
+        push_value(code(com), op::channel_new, com.types.size_of(inner));
+        return { type_channel{ .inner_type = {inner} } };
+    }
+    if (node.name == "soa") {
+        node.token.assert_eq(node.args.size(), 1, "@soa only accepts one argument");
+        const auto inner = resolve_type(com, node.token, node.args[0]);
+        return { type_type{}, {type_name{get_soa_type(com, node.token, inner)}} };
+    }
+    if (node.name == "soa_new") {
+        node.token.assert_eq(node.args.size(), 3, "@soa_new requires a type, a count and an arena");
+        const auto inner = resolve_type(com, node.token, node.args[0]);
+        const auto soa = get_soa_type(com, node.token, inner);
+
+        // Each field is allocated separately with its elements zeroed. The element sizes go
+        // on the stack first so that the count and arena only need to be evaluated once.
+        const auto fields = com.types.fields_of(inner.as<type_struct>());
+        for (const auto& field : fields) {
+            push_value(code(com), op::push_u64, std::uint64_t{com.types.size_of(field.type)});
+        }
+        const auto count_type = push_expr(com, compile_type::val, *node.args[1]).type;
+        node.token.assert_eq(count_type, type_name{type_u64{}}, "incorrect type for @soa_new count");
+        const auto arena_type = push_expr(com, compile_type::val, *node.args[2]).type;
+        node.token.assert_eq(arena_type, type_name{type_arena{}}.add_ptr(), "incorrect type for arena");
+        push_load(com, sizeof(std::byte*)); // load the arena
+        push_value(code(com), op::arena_alloc_soa, fields.size());
+        return { soa };
+    }
+    if (node.name == "send") {
+        node.token.assert_eq(node.args.size(), 2, "@send requires a channel and a value");
+        const auto channel_type = push_expr(com, compile_type::val, *node.args[0]).type;
+        node.token.assert(channel_type.is<type_channel>(), "@send bad first arg of type '{}'", channel_type);
+        const auto inner = *channel_type.as<type_channel>().inner_type;
+        push_copy_typechecked(com, *node.args[1], inner, node.token);
+        push_value(code(com), op::channel_send, com.types.size_of(inner));
+        return { type_null{} };
+    }
+    if (node.name == "recv") {
+        node.token.assert_eq(node.args.size(), 1, "@recv requires a channel");
+        const auto channel_type = push_expr(com, compile_type::val, *node.args[0]).type;
+        node.token.assert(channel_type.is<type_channel>(), "@recv bad arg of type '{}'", channel_type);
+        const auto inner = *channel_type.as<type_channel>().inner_type;
+        push_value(code(com), op::channel_recv, com.types.size_of(inner));
+        return { inner };
+    }
+    if (node.name == "spawn") {
+        node.token.assert(node.args.size() >= 1, "@spawn requires a function to run");
+        const auto type = type_of_expr(com, *node.args[0]).type;
+        node.token.assert(type.is<type_function>(), "@spawn can only run functions, got {}", type);
+        const auto& info = type.as<type_function>();
+        const auto args_size = push_args_typechecked(com, node.token, node.args | std::views::drop(1), info.param_types);
+        push_value(code(com), op::spawn, info.id, args_size);
+        return { type_u64{} };
+    }
+    if (node.name == "join") {
+        node.token.assert_eq(node.args.size(), 1, "@join requires a worker handle");
+        const auto handle_type = push_expr(com, compile_type::val, *node.args[0]).type;
+        node.token.assert_eq(handle_type, type_name{type_u64{}}, "incorrect type for worker handle");
+        push_value(code(com), op::join);
+        return { type_null{} };
+    }
+    if (node.name == "args") {
+        node.token.assert_eq(node.args.size(), 0, "@args does not take any arguments");
+        push_value(code(com), op::push_args);
+        return { type_name{type_char{}}.add_const().add_span().add_const().add_span() };
+    }
+    if (node.name == "atomic_load") {
+        node.token.assert_eq(node.args.size(), 1, "@atomic_load requires a pointer");
+        const auto type = push_atomic_ptr(com, node.token, *node.args[0], false);
+        push_value(code(com), op::atomic_load);
+        return { type };
+    }
+    if (node.name == "atomic_store") {
+        node.token.assert_eq(node.args.size(), 2, "@atomic_store requires a pointer and a value");
+        const auto type = push_atomic_ptr(com, node.token, *node.args[0], true);
+        push_copy_typechecked(com, *node.args[1], type, node.token);
+        push_value(code(com), op::atomic_store);
+        return { type_null{} };
+    }
+    if (node.name == "atomic_add") {
+        node.token.assert_eq(node.args.size(), 2, "@atomic_add requires a pointer and a value");
+        const auto type = push_atomic_ptr(com, node.token, *node.args[0], true);
+        push_copy_typechecked(com, *node.args[1], type, node.token);
+        push_value(code(com), op::atomic_add);
+        return { type }; // the previous value
+    }
+    if (node.name == "atomic_cas") {
+        node.token.assert_eq(node.args.size(), 3, "@atomic_cas requires a pointer, an expected value and a new value");
+        const auto type = push_atomic_ptr(com, node.token, *node.args[0], true);
+        push_copy_typechecked(com, *node.args[1], type, node.token);
+        push_copy_typechecked(com, *node.args[2], type, node.token);
+        push_value(code(com), op::atomic_cas);
+        return { type_bool{} };
+    }
+    if (node.name == "popcount" || node.name == "ctz" || node.name == "clz") {
+        node.token.assert_eq(node.args.size(), 1, "@{} only accepts one argument", node.name);
+        const auto type = push_expr(com, compile_type::val, *node.args[0]).type;
+        node.token.assert(type.is<type_i64>() || type.is<type_u64>(), "@{} requires an i64 or u64, got {}", node.name, type);
+        if (node.name == "popcount") push_value(code(com), op::u64_popcount);
+        else if (node.name == "ctz") push_value(code(com), op::u64_ctz);
+        else                         push_value(code(com), op::u64_clz);
+        return { type_u64{} };
+    }
+    if (node.name == "rotl") {
+        node.token.assert_eq(node.args.size(), 2, "@rotl requires a value and a bit count");
+        const auto type = push_expr(com, compile_type::val, *node.args[0]).type;
+        node.token.assert(type.is<type_i64>() || type.is<type_u64>(), "@rotl requires an i64 or u64, got {}", type);
+        push_copy_typechecked(com, *node.args[1], type_u64{}, node.token);
+        push_value(code(com), op::u64_rotl);
+        return { type.remove_const() };
+    }
+    if (node.name == "sqrt")  return push_float_intrinsic(com, node, op::f64_sqrt, 1);
+    if (node.name == "floor") return push_float_intrinsic(com, node, op::f64_floor, 1);
+    if (node.name == "ceil")  return push_float_intrinsic(com, node, op::f64_ceil, 1);
+    if (node.name == "round") return push_float_intrinsic(com, node, op::f64_round, 1);
+    if (node.name == "exp")   return push_float_intrinsic(com, node, op::f64_exp, 1);
+    if (node.name == "log")   return push_float_intrinsic(com, node, op::f64_log, 1);
+    if (node.name == "sin")   return push_float_intrinsic(com, node, op::f64_sin, 1);
+    if (node.name == "cos")   return push_float_intrinsic(com, node, op::f64_cos, 1);
+    if (node.name == "tan")   return push_float_intrinsic(com, node, op::f64_tan, 1);
+    if (node.name == "pow")   return push_float_intrinsic(com, node, op::f64_pow, 2);
+    if (node.name == "atan2") return push_float_intrinsic(com, node, op::f64_atan2, 2);
+    if (node.name == "min" || node.name == "max" || node.name == "abs") {
+        return push_numeric_intrinsic(com, node);
+    }
+    if (node.name.starts_with("bits_")) {
+        return push_bits_intrinsic(com, node);
+    }
     node.token.error("no intrisic function named @{} exists", node.name);
 }
 
 auto push_expr(compiler& com, compile_type ct, const node_as_expr& node) -> expr_result
 {
     node.token.assert(ct == compile_type::val, "cannot take the address of an 'as' statement");
-    const auto src_type = push_expr(com, ct, *node.expr).type;
+    const auto begin = code(com).size();
+    const auto [src_type, src_value] = push_expr(com, ct, *node.expr);
     const auto result = push_expr(com, ct, *node.type);
     const auto dst_type = get_type_value(node.token, result);
+    if (src_type.remove_const() == dst_type.remove_const()) {
+        return { dst_type, src_value };
+    }
+
+    // Conversions to and from narrow types go via the 64 bit type of the same kind
+    const auto src_promotion = get_promotion(src_type);
+    const auto dst_promotion = get_promotion(dst_type);
+    if (src_promotion) push_value(code(com), src_promotion->widen);
 
     std::visit(overloaded{
         [&] <class T> (const T&, const T&) {}, // noop
@@ -1675,33 +2869,438 @@ auto push_expr(compiler& com, compile_type ct, const node_as_expr& node) -> expr
         [&](const auto&, const auto&) {
             node.token.error("cannot convert expression of type '{}' to '{}'", src_type, dst_type);
         }
-    }, src_type, dst_type);
+    }, src_promotion ? src_promotion->wide_type : src_type, dst_promotion ? dst_promotion->wide_type : dst_type);
 
+    if (dst_promotion) push_value(code(com), dst_promotion->narrow);
+
+    // An empty value means null for null types but an unknown value for anything else
+    const auto known = src_value.has_value() || src_type.is<type_null>();
+    if (const auto value = known ? fold_conversion(src_value, dst_type) : const_value{}; value.has_value()) {
+        code(com).resize(begin);
+        return push_const_value(com, dst_type, value);
+    }
     return { dst_type };
 }
 
+// If the expression is a chain of data member accesses on a local, such as 'self._elems',
+// returns the chain as a string so that repeats of it can be found. The address it refers
+// to only changes if the local is redeclared, reassigned or, if it is a pointer, written to
+// through an alias, so chains on locals that the given code may do any of that to are
+// rejected. So are chains that go through more than one pointer, since those depend on
+// what is in memory.
+auto address_path(compiler& com, const side_effects& effects, const node_expr& node)
+    -> std::optional<std::string>
+{
+    if (!std::holds_alternative<node_field_expr>(node)) return std::nullopt;
+    const auto& field = std::get<node_field_expr>(node);
+
+    auto path = std::string{};
+    if (std::holds_alternative<node_name_expr>(*field.expr)) {
+        const auto& name = std::get<node_name_expr>(*field.expr).name;
+        if (effects.declared.contains(name) || effects.assigned.contains(name)) return std::nullopt;
+        if (current(com).address_taken.contains(name)) return std::nullopt;
+        const auto var = variables(com).find(curr_module(com), name);
+        if (!var || (var->type.is<type_ptr>() && var->type.remove_ptr().is<type_ptr>())) {
+            return std::nullopt;
+        }
+        path = name;
+    } else {
+        const auto object = address_path(com, effects, *field.expr);
+        if (!object || type_of_expr(com, *field.expr).type.is<type_ptr>()) return std::nullopt;
+        path = *object;
+    }
+
+    // Member functions are accessed in the same way as fields
+    const auto type = strip_pointers(type_of_expr(com, *field.expr).type);
+    if (!type.is<type_struct>()) return std::nullopt;
+    const auto is_field = [&](const auto& f) { return f.name == field.name; };
+    if (std::ranges::none_of(com.types.fields_of(type.as<type_struct>()), is_field)) return std::nullopt;
+    return std::format("{}.{}", path, field.name);
+}
+
+struct address_uses
+{
+    std::vector<const node_expr*> nodes;
+    std::size_t                   unconditional = 0; // uses outside of nested branches and loops
+};
+
+using address_map = std::unordered_map<std::string, address_uses>;
+
+auto find_address_paths(
+    compiler& com,
+    const side_effects& effects,
+    const node_expr& node,
+    bool unconditional,
+    address_map& found
+)
+    -> void
+{
+    const auto recurse = [&](const node_expr_ptr& expr, bool always = true) {
+        if (expr) find_address_paths(com, effects, *expr, unconditional && always, found);
+    };
+    std::visit(overloaded{
+        [&](const node_unary_op_expr& n)  { recurse(n.expr); },
+        [&](const node_binary_op_expr& n) {
+            const auto short_circuits = n.token.type == token_type::ampersand_ampersand
+                                     || n.token.type == token_type::bar_bar;
+            recurse(n.lhs);
+            recurse(n.rhs, !short_circuits);
+        },
+        [&](const node_call_expr& n) {
+            recurse(n.expr);
+            for (const auto& arg : n.args) recurse(arg);
+        },
+        [&](const node_template_expr& n) { recurse(n.expr); },
+        [&](const node_array_expr& n) {
+            for (const auto& element : n.elements) recurse(element);
+        },
+        [&](const node_repeat_array_expr& n) { recurse(n.value); },
+        [&](const node_addrof_expr& n)       { recurse(n.expr); },
+        [&](const node_span_expr& n) {
+            recurse(n.expr);
+            recurse(n.lower_bound);
+            recurse(n.upper_bound);
+        },
+        [&](const node_const_expr& n)     { recurse(n.expr); },
+        [&](const node_field_expr& n)     { recurse(n.expr); },
+        [&](const node_deref_expr& n)     { recurse(n.expr); },
+        [&](const node_subscript_expr& n) { recurse(n.expr); recurse(n.index); },
+        [&](const node_new_expr& n) {
+            recurse(n.arena);
+            recurse(n.count);
+            recurse(n.original);
+            recurse(n.expr);
+        },
+        [&](const node_ternary_expr& n) {
+            recurse(n.condition);
+            recurse(n.true_case, false);
+            recurse(n.false_case, false);
+        },
+        [&](const node_intrinsic_expr& n) {
+            for (const auto& arg : n.args) recurse(arg);
+        },
+        [&](const node_as_expr& n) { recurse(n.expr); },
+        [](const auto&) {}
+    }, node);
+
+    // Recorded after the object so that a chain comes after the chains it extends
+    if (com.cached_addresses.contains(&node)) return;
+    if (const auto path = address_path(com, effects, node)) {
+        auto& uses = found[*path];
+        uses.nodes.push_back(&node);
+        if (unconditional) ++uses.unconditional;
+    }
+}
+
+auto find_address_paths(
+    compiler& com,
+    const side_effects& effects,
+    const node_stmt& node,
+    bool unconditional,
+    address_map& found
+)
+    -> void
+{
+    const auto recurse_expr = [&](const node_expr_ptr& expr) {
+        if (expr) find_address_paths(com, effects, *expr, unconditional, found);
+    };
+    const auto recurse_body = [&](const node_stmt_ptr& stmt) {
+        if (stmt) find_address_paths(com, effects, *stmt, false, found);
+    };
+    std::visit(overloaded{
+        [&](const node_sequence_stmt& n) {
+            for (const auto& stmt : n.sequence) find_address_paths(com, effects, *stmt, unconditional, found);
+        },
+        [&](const node_loop_stmt& n)  { recurse_body(n.body); },
+        [&](const node_while_stmt& n) { recurse_expr(n.condition); recurse_body(n.body); },
+        [&](const node_for_stmt& n)   { recurse_expr(n.iter); recurse_body(n.body); },
+        [&](const node_if_stmt& n) {
+            recurse_expr(n.condition);
+            recurse_body(n.body);
+            recurse_body(n.else_body);
+        },
+        [&](const node_declaration_stmt& n) { recurse_expr(n.expr); },
+        [&](const node_assignment_stmt& n)  { recurse_expr(n.position); recurse_expr(n.expr); },
+        [&](const node_expression_stmt& n)  { recurse_expr(n.expr); },
+        [&](const node_return_stmt& n)      { recurse_expr(n.return_value); },
+        [&](const node_assert_stmt& n)      { recurse_expr(n.expr); },
+        [&](const node_print_stmt& n) {
+            for (const auto& arg : n.args) recurse_expr(arg);
+        },
+        [](const auto&) {}
+    }, node);
+}
+
+// Accessing a data member pushes the address of the object and adds the field offset, so
+// a block that uses the same field more than once repeats that arithmetic each time. The
+// address of each field access chain that is used more than once outside of any nested
+// branch or loop is instead computed once at the start of the block and kept in a local,
+// which the nested uses then also read.
+auto cache_addresses(compiler& com, const node_sequence_stmt& node) -> std::vector<const node_expr*>
+{
+    auto effects = side_effects{};
+    for (const auto& stmt : node.sequence) collect_declared_names(*stmt, effects.declared);
+    for (const auto& stmt : node.sequence) collect_side_effects(com, *stmt, effects);
+
+    auto found = address_map{};
+    for (const auto& stmt : node.sequence) find_address_paths(com, effects, *stmt, true, found);
+
+    auto paths = std::vector<std::string>{};
+    for (const auto& [path, uses] : found) {
+        if (uses.unconditional > 1) paths.push_back(path);
+    }
+
+    // Shorter chains first so that the chains that extend them use the cached address
+    std::ranges::sort(paths, [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+
+    auto cached = std::vector<const node_expr*>{};
+    for (const auto& path : paths) {
+        const auto& nodes = found[path].nodes;
+        const auto type = push_expr(com, compile_type::ptr, *nodes.front()).type;
+        const auto name = std::format("$address{}", com.cached_addresses.size());
+        declare_var(com, node.token, name, type.add_ptr());
+        for (const auto expr : nodes) {
+            com.cached_addresses.emplace(expr, hoisted_expr{com.current_function.back(), name, node.token});
+            cached.push_back(expr);
+        }
+    }
+    return cached;
+}
+
 void push_stmt(compiler& com, const node_sequence_stmt& node)
 {
     variables(com).new_scope();
+    const auto cached = in_function(com) ? cache_addresses(com, node) : std::vector<const node_expr*>{};
     for (const auto& seq_node : node.sequence) {
         push_stmt(com, *seq_node);
     }
+    for (const auto expr : cached) com.cached_addresses.erase(expr);
     variables(com).pop_scope(code(com));
 }
 
+// An expression is loop invariant if nothing it reads can change while the loop runs.
+// Locals can only change by being assigned to or through a pointer to them, and anything
+// behind a pointer may also be changed by a call. Globals are never invariant since other
+// workers may change them at any time. Memory behind a pointer that is shared with a worker
+// is only safe to wait on with the atomic intrinsics, which are never hoisted.
+auto is_loop_invariant(compiler& com, const side_effects& loop, const node_expr& node) -> bool
+{
+    return std::visit(overloaded{
+        [&](const node_name_expr& n) {
+            if (loop.assigned.contains(n.name) || loop.declared.contains(n.name)) return false;
+            if (!in_function(com)) return false;
+            const auto var = variables(com).find(curr_module(com), n.name);
+            return var && !current(com).address_taken.contains(n.name)
+                && type_of_expr(com, node).type == var->type;
+        },
+        [&](const node_field_expr& n) {
+            if (!is_loop_invariant(com, loop, *n.expr)) return false;
+            const auto type = type_of_expr(com, *n.expr).type;
+            return !type.is<type_ptr>() || !loop.writes_memory;
+        },
+        [&](const node_deref_expr& n) {
+            return !loop.writes_memory && is_loop_invariant(com, loop, *n.expr);
+        },
+        [&](const node_unary_op_expr& n) {
+            return is_loop_invariant(com, loop, *n.expr);
+        },
+        [&](const node_binary_op_expr& n) {
+            return is_loop_invariant(com, loop, *n.lhs) && is_loop_invariant(com, loop, *n.rhs);
+        },
+        [&](const node_intrinsic_expr& n) {
+            return n.name == "len" && n.args.size() == 1
+                && is_loop_invariant(com, loop, *n.args[0])
+                && type_of_expr(com, *n.args[0]).type.is<type_span>();
+        },
+        [&](const node_call_expr& n) {
+            // A read only function may read anything its arguments point to
+            if (loop.writes_memory) return false;
+            const auto callee = direct_callee(com, loop, n);
+            if (!callee || !is_read_only(com, *callee)) return false;
+            if (const auto field = std::get_if<node_field_expr>(&*n.expr)) {
+                if (!is_loop_invariant(com, loop, *field->expr)) return false;
+            }
+            return std::ranges::all_of(n.args, [&](const node_expr_ptr& arg) {
+                return is_loop_invariant(com, loop, *arg);
+            });
+        },
+        [](const literal_node auto&) { return true; },
+        [](const auto&)              { return false; }
+    }, node);
+}
+
+// True if evaluating the expression can never fail at runtime, so it is safe to evaluate
+// even if the code it appears in would not have run
+auto cannot_trap(compiler& com, const node_expr& node) -> bool
+{
+    return std::visit(overloaded{
+        [&](const node_name_expr&) { return true; },
+        [&](const node_field_expr& n) {
+            return !type_of_expr(com, *n.expr).type.is<type_ptr>() && cannot_trap(com, *n.expr);
+        },
+        [&](const node_unary_op_expr& n) { return cannot_trap(com, *n.expr); },
+        [&](const node_binary_op_expr& n) {
+            const auto divides = n.token.type == token_type::slash || n.token.type == token_type::percent;
+            return !divides && cannot_trap(com, *n.lhs) && cannot_trap(com, *n.rhs);
+        },
+        [&](const node_intrinsic_expr& n) {
+            return n.name == "len" && n.args.size() == 1 && cannot_trap(com, *n.args[0]);
+        },
+        [](const literal_node auto&) { return true; },
+        [](const auto&)              { return false; }
+    }, node);
+}
+
+// Finds the largest loop-invariant subexpressions of an expression in a loop. Only those
+// that are compiled as values are considered, so the objects that fields are accessed on
+// are skipped. Hoisting means the expression is evaluated even if the loop body never runs,
+// so anything that is not always evaluated must also be unable to fail.
+auto find_loop_invariants(
+    compiler& com,
+    const side_effects& loop,
+    const node_expr& node,
+    bool always_evaluated,
+    std::vector<const node_expr*>& found
+)
+    -> void
+{
+    if (is_loop_invariant(com, loop, node) && (always_evaluated || cannot_trap(com, node))) {
+        found.push_back(&node);
+        return;
+    }
+    const auto recurse = [&](const node_expr_ptr& expr, bool always) {
+        if (expr) find_loop_invariants(com, loop, *expr, always_evaluated && always, found);
+    };
+    std::visit(overloaded{
+        [&](const node_binary_op_expr& n) {
+            const auto short_circuits = n.token.type == token_type::ampersand_ampersand
+                                     || n.token.type == token_type::bar_bar;
+            recurse(n.lhs, true);
+            recurse(n.rhs, !short_circuits);
+        },
+        [&](const node_unary_op_expr& n)  { recurse(n.expr, true); },
+        [&](const node_subscript_expr& n) { recurse(n.index, true); },
+        [&](const node_span_expr& n)      { recurse(n.lower_bound, true); recurse(n.upper_bound, true); },
+        [&](const node_as_expr& n)        { recurse(n.expr, true); },
+        [&](const node_call_expr& n) {
+            for (const auto& arg : n.args) recurse(arg, true);
+        },
+        [&](const node_ternary_expr& n) {
+            recurse(n.condition, true);
+            recurse(n.true_case, false);
+            recurse(n.false_case, false);
+        },
+        [](const auto&) {}
+    }, node);
+}
+
+auto find_loop_invariants(
+    compiler& com,
+    const side_effects& loop,
+    const node_stmt& node,
+    std::vector<const node_expr*>& found
+)
+    -> void
+{
+    const auto recurse_expr = [&](const node_expr_ptr& expr) {
+        if (expr) find_loop_invariants(com, loop, *expr, false, found);
+    };
+    const auto recurse_stmt = [&](const node_stmt_ptr& stmt) {
+        if (stmt) find_loop_invariants(com, loop, *stmt, found);
+    };
+    std::visit(overloaded{
+        [&](const node_sequence_stmt& n) {
+            for (const auto& stmt : n.sequence) recurse_stmt(stmt);
+        },
+        [&](const node_loop_stmt& n)  { recurse_stmt(n.body); },
+        [&](const node_while_stmt& n) { recurse_expr(n.condition); recurse_stmt(n.body); },
+        [&](const node_for_stmt& n)   { recurse_expr(n.iter); recurse_stmt(n.body); },
+        [&](const node_if_stmt& n) {
+            recurse_expr(n.condition);
+            recurse_stmt(n.body);
+            recurse_stmt(n.else_body);
+        },
+        [&](const node_declaration_stmt& n) { recurse_expr(n.expr); },
+        [&](const node_assignment_stmt& n)  { recurse_expr(n.expr); },
+        [&](const node_expression_stmt& n)  { recurse_expr(n.expr); },
+        [&](const node_return_stmt& n)      { recurse_expr(n.return_value); },
+        [&](const node_print_stmt& n) {
+            for (const auto& arg : n.args) recurse_expr(arg);
+        },
+        [](const auto&) {}
+    }, node);
+}
+
+// Evaluates the loop-invariant parts of a loop once before the loop and stores them in
+// locals. Anything that is already a single op to compute is left alone. The given effects
+// describe what the loop itself changes outside of the condition and body, and the condition
+// is evaluated at the start of every iteration.
+auto hoist_loop_invariants(
+    compiler& com,
+    const token& tok,
+    side_effects loop,
+    const node_expr* condition,
+    const node_stmt& body
+)
+    -> std::vector<const node_expr*>
+{
+    collect_declared_names(body, loop.declared);
+    if (condition) collect_side_effects(com, *condition, loop);
+    collect_side_effects(com, body, loop);
+
+    auto candidates = std::vector<const node_expr*>{};
+    if (condition) find_loop_invariants(com, loop, *condition, true, candidates);
+    find_loop_invariants(com, loop, body, candidates);
+
+    auto hoisted = std::vector<const node_expr*>{};
+    for (const auto expr : candidates) {
+        const auto begin = code(com).size();
+        const auto [type, value] = push_expr(com, compile_type::val, *expr);
+        if (value.has_value() || code(com).size() == begin) {
+            code(com).resize(begin);
+            continue;
+        }
+        auto first = op{};
+        std::memcpy(&first, &code(com)[begin], sizeof(op));
+        if (begin + sizeof(op) + operands_size(first) == code(com).size()) {
+            code(com).resize(begin);
+            continue;
+        }
+        const auto name = std::format("$invariant{}", com.hoisted.size());
+        declare_var(com, tok, name, type);
+        com.hoisted.emplace(expr, hoisted_expr{com.current_function.back(), name, tok});
+        hoisted.push_back(expr);
+    }
+    return hoisted;
+}
+
 void push_stmt(compiler& com, const node_loop_stmt& node)
 {
+    variables(com).new_scope();
+    const auto hoisted = hoist_loop_invariants(com, node.token, {}, nullptr, *node.body);
+
     push_loop(com, [&] {
         push_stmt(com, *node.body);
     });
+
+    for (const auto expr : hoisted) com.hoisted.erase(expr);
+    variables(com).pop_scope(code(com));
 }
 
-//loop {
-//    if !<condition> break;
-//    <body>
+//{
+//    let invariants := <loop-invariant parts of condition>;
+//    loop {
+//        if !<condition> break;
+//        <body>
+//    }
 //}
 void push_stmt(compiler& com, const node_while_stmt& node)
 {
+    variables(com).new_scope();
+    const auto hoisted = hoist_loop_invariants(com, node.token, {}, node.condition.get(), *node.body);
+
     push_loop(com, [&] {
         // if !<condition> break;
         const auto cond_type = push_expr(com, compile_type::val, *node.condition).type;
@@ -1714,6 +3313,9 @@ void push_stmt(compiler& com, const node_while_stmt& node)
         // <body>
         push_stmt(com, *node.body);
     });
+
+    for (const auto expr : hoisted) com.hoisted.erase(expr);
+    variables(com).pop_scope(code(com));
 }
 
 //{
@@ -1739,6 +3341,11 @@ void push_for_loop_span(compiler& com, const node_for_stmt& node, const type_spa
     push_value(code(com), op::push_u64, std::uint64_t{0});
     declare_var(com, node.token, "$idx", type_u64{});
 
+    auto loop = side_effects{};
+    loop.assigned.insert("$idx");
+    collect_declared_names(node.names, loop.declared);
+    const auto hoisted = hoist_loop_invariants(com, node.token, std::move(loop), nullptr, *node.body);
+
     push_loop(com, [&] {
         // if idx == size break;
         push_var_val(com, node.token, curr_module(com), "$idx");
@@ -1764,11 +3371,13 @@ void push_for_loop_span(compiler& com, const node_for_stmt& node, const type_spa
         push_var_val(com, node.token, curr_module(com), "$idx");
         push_value(code(com), op::push_u64, std::uint64_t{1}, op::u64_add);
         push_var_addr(com, node.token, curr_module(com), "$idx");
-        push_value(code(com), op::save, com.types.size_of(type_u64{}));
+        push_save(com, com.types.size_of(type_u64{}));
 
         // main body
         push_stmt(com, *node.body);
     });
+
+    for (const auto expr : hoisted) com.hoisted.erase(expr);
 }
 
 //{
@@ -1802,6 +3411,13 @@ void push_for_loop_iterator(compiler& com, const node_for_stmt& node, const type
     node.token.assert_eq(next_fn.params.size(), 1, "'next' must only take one arg");
     node.token.assert_eq(next_fn.params[0], type_name{type}.add_ptr(), "'next' first arg must be a self pointer");
 
+    // Calling next() advances the iterator and may write anywhere
+    auto loop = side_effects{};
+    loop.assigned.insert("$iter");
+    loop.writes_memory = true;
+    collect_declared_names(node.names, loop.declared);
+    const auto hoisted = hoist_loop_invariants(com, node.token, std::move(loop), nullptr, *node.body);
+
     push_loop(com, [&] {
         // if !obj.valid() { break; }
         push_var_addr(com, node.token, curr_module(com), "$iter");
@@ -1819,6 +3435,8 @@ void push_for_loop_iterator(compiler& com, const node_for_stmt& node, const type
         // main body
         push_stmt(com, *node.body);
     });
+
+    for (const auto expr : hoisted) com.hoisted.erase(expr);
 }
 
 void push_stmt(compiler& com, const node_for_stmt& node)
@@ -1920,7 +3538,29 @@ auto push_stmt(compiler& com, const node_declaration_stmt& node) -> void
                                    : expr_type;
     type.is_const = node.add_const;
     node.token.assert(!type.is<type_arena>(), "cannot create copies of arenas");
+
+    // Globals live at the bottom of the stack and every frame starts at an 8-byte aligned
+    // address, so variables can be given their natural alignment. The atomic intrinsics rely
+    // on this. Function parameters are still packed.
+    const auto next = variables(com).scopes().back().next;
+    const auto align = com.types.align_of(type);
+    if (const auto padding = (align - next % align) % align; padding > 0) {
+        push_value(code(com), op::push, padding);
+        variables(com).skip(padding);
+    }
+
+    const auto begin = code(com).size();
     push_copy_typechecked(com, *node.expr, type, node.token);
+
+    // Const arrays that are entirely known at compile time are used directly from the rom
+    const auto name = std::get_if<std::string>(&node.names.names);
+    if (const auto rom_location = rom_location_of_pushes(com, begin); name && type.is_const && rom_location) {
+        code(com).resize(begin);
+        if (!current(com).variables.declare_rom(curr_module(com), *name, type, *rom_location)) {
+            node.token.error("name already in use: '{}'", *name);
+        }
+        return;
+    }
     push_name_pack(com, node.token, node.names, type, expr_value);
 }
 
@@ -1936,7 +3576,7 @@ void push_stmt(compiler& com, const node_assignment_stmt& node)
     node.token.assert(!lhs_type.is_const, "cannot assign to a const variable");
     push_copy_typechecked(com, *node.expr, lhs_type, node.token);
     const auto lhs = push_expr(com, compile_type::ptr, *node.position).type;
-    push_value(code(com), op::save, com.types.size_of(lhs));
+    push_save(com, com.types.size_of(lhs));
     return;
 }
 
@@ -1963,6 +3603,20 @@ void push_stmt(compiler& com, const node_return_stmt& node)
 {
     node.token.assert(in_function(com), "can only return within functions");
     const auto return_type = current(com).return_type;
+
+    // A local of the return type is moved straight into the return slot rather than being
+    // pushed onto the stack and then copied down
+    if (std::holds_alternative<node_name_expr>(*node.return_value)) {
+        const auto& name = std::get<node_name_expr>(*node.return_value).name;
+        const auto var = variables(com).find(curr_module(com), name);
+        if (var && !var->rom_location && var->type.remove_const() == return_type.remove_const()) {
+            check_copyable(node.token, var->type.remove_const(), return_type.remove_const());
+            variables(com).handle_function_exit(code(com));
+            push_value(code(com), op::ret_local, var->location, com.types.size_of(return_type));
+            return;
+        }
+    }
+
     push_copy_typechecked(com, *node.return_value, return_type, node.token);
     variables(com).handle_function_exit(code(com));
     push_value(code(com), op::ret, com.types.size_of(return_type));
@@ -2002,6 +3656,22 @@ void push_stmt(compiler& com, const node_print_stmt& node)
 
 auto push_expr(compiler& com, compile_type ct, const node_expr& expr) -> expr_result
 {
+    // Loop-invariant expressions are read from the local they were hoisted into
+    const auto it = com.hoisted.find(&expr);
+    if (it != com.hoisted.end() && ct == compile_type::val && it->second.function == com.current_function.back()) {
+        return push_var_val(com, it->second.token, curr_module(com), it->second.name);
+    }
+
+    // Repeated field accesses go through the address that was computed at the start of the block
+    const auto cached = com.cached_addresses.find(&expr);
+    if (cached != com.cached_addresses.end() && cached->second.function == com.current_function.back()) {
+        const auto& [function, name, token] = cached->second;
+        const auto type = push_var_val(com, token, curr_module(com), name).type.remove_ptr();
+        if (ct == compile_type::val) {
+            push_load(com, com.types.size_of(type));
+        }
+        return { type };
+    }
     return std::visit([&](const auto& node) { return push_expr(com, ct, node); }, expr);
 }
 
@@ -2010,11 +3680,75 @@ auto push_stmt(compiler& com, const node_stmt& root) -> void
     std::visit([&](const auto& node) { push_stmt(com, node); }, root);
 }
 
+auto remap_function_ids(std::vector<std::byte>& code, const std::vector<std::size_t>& new_ids) -> void
+{
+    for (auto ptr = code.data(); ptr < code.data() + code.size();) {
+        auto op_code = op{};
+        std::memcpy(&op_code, ptr, sizeof(op));
+        if (op_code == op::call_static || op_code == op::push_function_ptr || op_code == op::spawn) {
+            auto id = std::uint64_t{};
+            std::memcpy(&id, ptr + sizeof(op), sizeof(id));
+            id = new_ids[id];
+            std::memcpy(ptr + sizeof(op), &id, sizeof(id));
+        }
+        ptr += sizeof(op) + operands_size(op_code);
+    }
 }
 
-auto compile(const anzu_module& ast) -> bytecode_program
+// Merges functions with byte-identical code, which is common for template instantiations
+// over types of the same size. The remaining functions are renumbered and every reference
+// to a function id is rewritten. This repeats until nothing changes, since merging the
+// functions that two others call can make those two identical as well.
+auto fold_identical_functions(bytecode_program& program) -> void
+{
+    while (true) {
+        const auto num_functions = program.functions.size();
+        auto first_with_code = std::unordered_map<std::string_view, std::size_t>{};
+        auto new_ids = std::vector<std::size_t>(num_functions);
+        for (const auto& function : program.functions) {
+            const auto data = reinterpret_cast<const char*>(function.code.data());
+            const auto it = first_with_code.emplace(std::string_view{data, function.code.size()}, function.id).first;
+            new_ids[function.id] = it->second;
+        }
+        if (first_with_code.size() == num_functions) {
+            return;
+        }
+
+        // The first function with the given code is kept, so it is always seen before its duplicates
+        auto kept = std::vector<bytecode_function>{};
+        auto kept_index = std::vector<std::size_t>(num_functions);
+        for (auto& function : program.functions) {
+            if (new_ids[function.id] == function.id) {
+                kept_index[function.id] = kept.size();
+                kept.push_back(std::move(function));
+            } else {
+                auto& into = kept[kept_index[new_ids[function.id]]];
+                into.merged_names.push_back(std::move(function.name));
+                std::ranges::move(function.merged_names, std::back_inserter(into.merged_names));
+            }
+        }
+        for (auto& id : new_ids) {
+            id = kept_index[id];
+        }
+        for (std::size_t index = 0; index != kept.size(); ++index) {
+            kept[index].id = index;
+            remap_function_ids(kept[index].code, new_ids);
+        }
+        program.functions = std::move(kept);
+    }
+}
+
+}
+
+auto compile(const anzu_module& ast, const native_registry& natives) -> bytecode_program
 {
     auto com = compiler{};
+    for (const auto& native : natives.functions()) {
+        const auto [it, success] = com.natives_by_name.emplace(native.name, com.natives.size());
+        if (!success) panic("multiple native functions named {} registered", native.name);
+        com.natives.push_back(native);
+    }
+
     const auto fname = function_name{"__main__", no_struct, "$main"};
     com.functions.emplace_back(fname, 0, variable_manager{false});
 
@@ -2033,7 +3767,23 @@ auto compile(const anzu_module& ast) -> bytecode_program
     auto program = bytecode_program{};
     program.rom = com.rom;
     for (const auto& function : com.functions) {
-        program.functions.push_back(bytecode_function{function.name.to_string(), function.id, function.code});
+        program.functions.push_back(bytecode_function{
+            .name = function.name.to_string(),
+            .id = function.id,
+            .code = function.code,
+            .return_size = com.types.size_of(function.return_type)
+        });
+    }
+    for (const auto& native : com.natives) {
+        program.natives.push_back(bytecode_native{native.name, native.ptr});
+    }
+    fold_identical_functions(program);
+    for (auto& function : program.functions) {
+        function.wide_size = function.code.size();
+        function.code = encode_operands(function.code);
+    }
+    if (const auto error = verify_program(program)) {
+        panic("compiler produced invalid bytecode: {}", *error);
     }
     return program;
 }
@@ -3,7 +3,9 @@
 #include "parser.hpp"
 #include "bytecode.hpp"
 #include "names.hpp"
+#include "native.hpp"
 
+#include "compilation/ctfe.hpp"
 #include "compilation/type_manager.hpp"
 #include "compilation/variable_manager.hpp"
 
@@ -13,6 +15,7 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 namespace anzu {
 
@@ -25,6 +28,20 @@ struct function
     std::vector<type_name> params;
     type_name              return_type;
     std::vector<std::byte> code;
+
+    // Names of the locals whose address may be taken somewhere in the function body
+    std::unordered_set<std::string> address_taken = {};
+
+    // False if the function body never writes through a pointer or calls anything that might
+    bool writes_memory = true;
+};
+
+// An expression that has been evaluated ahead of where it appears into a local
+struct hoisted_expr
+{
+    std::size_t function;
+    std::string name;
+    anzu::token token;
 };
 
 struct compiler
@@ -37,6 +54,9 @@ struct compiler
     std::unordered_set<std::filesystem::path> modules;
 
     std::unordered_map<function_name, std::size_t> functions_by_name;
+
+    std::vector<native_function>                 natives;
+    std::unordered_map<std::string, std::size_t> natives_by_name;
     
     std::unordered_map<type_function_template, node_function_stmt> function_templates;
     std::unordered_map<type_struct_template,   node_struct_stmt>   struct_templates;
@@ -46,8 +66,17 @@ struct compiler
     std::vector<std::size_t>           current_function;
 
     std::vector<const std::unordered_set<std::string>*> current_placeholders;
+
+    std::unordered_map<const node_expr*, hoisted_expr> hoisted;          // loop-invariant values
+    std::unordered_map<const node_expr*, hoisted_expr> cached_addresses; // repeated field addresses
+
+    // The rom position and size of each file embedded so far, since @embed_file is compiled
+    // again every time the type of an expression containing it is needed
+    std::unordered_map<std::string, std::pair<std::size_t, std::size_t>> embedded_files;
+
+    ctfe_state ctfe;
 };
 
-auto compile(const anzu_module& ast) -> bytecode_program;
+auto compile(const anzu_module& ast, const native_registry& natives = {}) -> bytecode_program;
 
 }
\ No newline at end of file
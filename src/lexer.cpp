@@ -63,10 +63,13 @@ auto identifier_type(std::string_view token) -> token_type
     if (token == "const")    return token_type::kw_const;
     if (token == "continue") return token_type::kw_continue;
     if (token == "else")     return token_type::kw_else;
+    if (token == "f32")      return token_type::kw_f32;
     if (token == "f64")      return token_type::kw_f64;
     if (token == "false")    return token_type::kw_false;
     if (token == "fn")       return token_type::kw_function;
     if (token == "for")      return token_type::kw_for;
+    if (token == "i8")       return token_type::kw_i8;
+    if (token == "i16")      return token_type::kw_i16;
     if (token == "i32")      return token_type::kw_i32;
     if (token == "i64")      return token_type::kw_i64;
     if (token == "if")       return token_type::kw_if;
@@ -81,6 +84,9 @@ auto identifier_type(std::string_view token) -> token_type
     if (token == "struct")   return token_type::kw_struct;
     if (token == "true")     return token_type::kw_true;
     if (token == "type")     return token_type::kw_type;
+    if (token == "u8")       return token_type::kw_u8;
+    if (token == "u16")      return token_type::kw_u16;
+    if (token == "u32")      return token_type::kw_u32;
     if (token == "u64")      return token_type::kw_u64;
     if (token == "var")      return token_type::kw_var;
     if (token == "while")    return token_type::kw_while;
@@ -111,10 +117,16 @@ auto lexer::make_number() -> token
     while (valid() && std::isdigit(peek())) advance(); // won't do anything if not a float
 
     static constexpr auto suffixes = {
+        std::pair{"u8"sv,  tt::uint8},
+        std::pair{"u16"sv, tt::uint16},
+        std::pair{"u32"sv, tt::uint32},
         std::pair{"u64"sv, tt::uint64},
         std::pair{"u"sv,   tt::uint64},
+        std::pair{"i8"sv,  tt::int8},
+        std::pair{"i16"sv, tt::int16},
         std::pair{"i32"sv, tt::int32},
         std::pair{"i64"sv, tt::int64},
+        std::pair{"f32"sv, tt::float32},
         std::pair{"f64"sv, tt::float64}
     };
     for (const auto& [suffix, type] : suffixes) {
@@ -239,14 +251,17 @@ auto lexer::get_token() -> token
         case '*': return make_token(token_type::star);
         case '%': return make_token(token_type::percent);
         case '~': return make_token(token_type::tilde);
+        case '^': return make_token(token_type::caret);
         case '!': return make_token(
             match("=") ? token_type::bang_equal : token_type::bang);
         case '=': return make_token(
             match("=") ? token_type::equal_equal : token_type::equal);
         case '<': return make_token(
-            match("=") ? token_type::less_equal : token_type::less);
+            match("=") ? token_type::less_equal :
+            match("<") ? token_type::less_less : token_type::less);
         case '>': return make_token(
-            match("=") ? token_type::greater_equal : token_type::greater);
+            match("=") ? token_type::greater_equal :
+            match(">") ? token_type::greater_greater : token_type::greater);
         case ':': return make_token(
             match("=") ? token_type::colon_equal : token_type::colon);
         case '|': return make_token(
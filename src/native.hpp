@@ -0,0 +1,151 @@
+#pragma once
+#include "bytecode.hpp"
+#include "object.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace anzu {
+
+struct native_function
+{
+    std::string            name;
+    std::vector<type_name> param_types;
+    type_name              return_type;
+    native_function_ptr    ptr;
+};
+
+template <typename T>
+struct is_std_span : std::false_type {};
+
+template <typename T>
+struct is_std_span<std::span<T>> : std::true_type {};
+
+// Maps the C++ types that can cross the native boundary onto their Anzu equivalent.
+// Spans have the same layout in both, a pointer followed by a size.
+template <typename T>
+auto to_type_name() -> type_name
+{
+    if constexpr (std::is_void_v<T>)                       return type_null{};
+    else if constexpr (std::is_same_v<T, bool>)            return type_bool{};
+    else if constexpr (std::is_same_v<T, char>)            return type_char{};
+    else if constexpr (std::is_same_v<T, std::int8_t>)     return type_i8{};
+    else if constexpr (std::is_same_v<T, std::int16_t>)    return type_i16{};
+    else if constexpr (std::is_same_v<T, std::int32_t>)    return type_i32{};
+    else if constexpr (std::is_same_v<T, std::int64_t>)    return type_i64{};
+    else if constexpr (std::is_same_v<T, std::uint8_t>)    return type_u8{};
+    else if constexpr (std::is_same_v<T, std::uint16_t>)   return type_u16{};
+    else if constexpr (std::is_same_v<T, std::uint32_t>)   return type_u32{};
+    else if constexpr (std::is_same_v<T, std::uint64_t>)   return type_u64{};
+    else if constexpr (std::is_same_v<T, float>)           return type_f32{};
+    else if constexpr (std::is_same_v<T, double>)          return type_f64{};
+    else if constexpr (is_std_span<T>::value) {
+        using element = typename T::element_type;
+        auto inner = to_type_name<std::remove_const_t<element>>();
+        if constexpr (std::is_const_v<element>) inner = inner.add_const();
+        return inner.add_span();
+    }
+    else static_assert(sizeof(T) == 0, "type cannot be passed to or from a native function");
+}
+
+// The number of bytes a value of type T takes up on the VM stack
+template <typename T>
+constexpr auto native_size() -> std::size_t
+{
+    if constexpr (is_std_span<T>::value) return sizeof(void*) + sizeof(std::uint64_t);
+    else return sizeof(T);
+}
+
+// Spans are read and written as their pointer and size rather than copied bytewise, since
+// the layout of std::span is not guaranteed to match
+template <typename T>
+auto read_native(const std::byte* src) -> T
+{
+    if constexpr (is_std_span<T>::value) {
+        auto data = static_cast<typename T::element_type*>(nullptr);
+        auto size = std::uint64_t{0};
+        std::memcpy(&data, src, sizeof(data));
+        std::memcpy(&size, src + sizeof(data), sizeof(size));
+        return T{data, size};
+    } else {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto value = T{};
+        std::memcpy(&value, src, sizeof(T));
+        return value;
+    }
+}
+
+template <typename T>
+auto write_native(const T& value, std::byte* dst) -> void
+{
+    if constexpr (is_std_span<T>::value) {
+        const auto data = value.data();
+        const auto size = std::uint64_t{value.size()};
+        std::memcpy(dst, &data, sizeof(data));
+        std::memcpy(dst + sizeof(data), &size, sizeof(size));
+    } else {
+        static_assert(std::is_trivially_copyable_v<T>);
+        std::memcpy(dst, &value, sizeof(T));
+    }
+}
+
+// Unpacks the arguments from the VM stack, calls the function and writes back the result
+template <typename Ret, typename... Args>
+auto call_native(Ret(*func)(Args...), const std::byte* args, std::byte* result) -> void
+{
+    auto offset = std::size_t{0};
+    const auto next = [&]<typename T>() {
+        const auto value = read_native<T>(args + offset);
+        offset += native_size<T>();
+        return value;
+    };
+    // Elements of a braced init list are evaluated in order, so the offsets line up
+    auto values = std::tuple<std::remove_cvref_t<Args>...>{
+        next.template operator()<std::remove_cvref_t<Args>>()...
+    };
+
+    if constexpr (std::is_void_v<Ret>) {
+        std::apply(func, values);
+        *result = std::byte{0}; // returns null
+    } else {
+        write_native(std::apply(func, values), result);
+    }
+}
+
+template <typename Ret, typename... Args>
+auto make_native(std::string name, Ret(*)(Args...), native_function_ptr ptr) -> native_function
+{
+    return native_function{
+        .name = std::move(name),
+        .param_types = {to_type_name<std::remove_cvref_t<Args>>()...},
+        .return_type = to_type_name<Ret>(),
+        .ptr = ptr
+    };
+}
+
+// A set of host functions that Anzu programs can call. Registered functions are
+// visible by name from every module, and are called directly through op::call_native.
+class native_registry
+{
+    std::vector<native_function> d_functions;
+
+public:
+    template <auto Func>
+    auto add(std::string name) -> void
+    {
+        const auto thunk = [](const std::byte* args, std::byte* result) {
+            call_native(+Func, args, result);
+        };
+        d_functions.push_back(make_native(std::move(name), +Func, thunk));
+    }
+
+    auto functions() const -> const std::vector<native_function>& { return d_functions; }
+};
+
+}
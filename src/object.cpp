@@ -63,6 +63,16 @@ auto type_char::to_string() const -> std::string
     return "char";
 }
 
+auto type_i8::to_string() const -> std::string
+{
+    return "i8";
+}
+
+auto type_i16::to_string() const -> std::string
+{
+    return "i16";
+}
+
 auto type_i32::to_string() const -> std::string
 {
     return "i32";
@@ -73,11 +83,31 @@ auto type_i64::to_string() const -> std::string
     return "i64";
 }
 
+auto type_u8::to_string() const -> std::string
+{
+    return "u8";
+}
+
+auto type_u16::to_string() const -> std::string
+{
+    return "u16";
+}
+
+auto type_u32::to_string() const -> std::string
+{
+    return "u32";
+}
+
 auto type_u64::to_string() const -> std::string
 {
     return "u64";
 }
 
+auto type_f32::to_string() const -> std::string
+{
+    return "f32";
+}
+
 auto type_f64::to_string() const -> std::string
 {
     return "f64";
@@ -122,6 +152,11 @@ auto type_span::to_string() const -> std::string
     return std::format("{}[]", to_string_paren(*inner_type));
 }
 
+auto type_channel::to_string() const -> std::string
+{
+    return std::format("@channel({})", *inner_type);
+}
+
 auto type_function_ptr::to_string() const -> std::string
 {
     return std::format(
@@ -159,6 +194,12 @@ auto type_function::to_string() const -> std::string
     return std::format("<function: id {} {}>", id, function_ptr_type);
 }
 
+auto type_native_function::to_string() const -> std::string
+{
+    const auto function_ptr_type = type_function_ptr{param_types, return_type};
+    return std::format("<native_function: id {} {}>", id, function_ptr_type);
+}
+
 auto type_function_template::to_string() const -> std::string
 {
     return std::format("<function_template: <{}>.{}.{}>", module.string(), struct_name.name, name);
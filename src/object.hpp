@@ -42,6 +42,20 @@ struct type_char
     auto operator==(const type_char&) const -> bool = default;
 };
 
+struct type_i8
+{
+    auto to_hash() const { return hash(0); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_i8&) const -> bool = default;
+};
+
+struct type_i16
+{
+    auto to_hash() const { return hash(0); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_i16&) const -> bool = default;
+};
+
 struct type_i32
 {
     auto to_hash() const { return hash(0); }
@@ -56,6 +70,27 @@ struct type_i64
     auto operator==(const type_i64&) const -> bool = default;
 };
 
+struct type_u8
+{
+    auto to_hash() const { return hash(0); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_u8&) const -> bool = default;
+};
+
+struct type_u16
+{
+    auto to_hash() const { return hash(0); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_u16&) const -> bool = default;
+};
+
+struct type_u32
+{
+    auto to_hash() const { return hash(0); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_u32&) const -> bool = default;
+};
+
 struct type_u64
 {
     auto to_hash() const { return hash(0); }
@@ -63,6 +98,13 @@ struct type_u64
     auto operator==(const type_u64&) const -> bool = default;
 };
 
+struct type_f32
+{
+    auto to_hash() const { return hash(0); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_f32&) const -> bool = default;
+};
+
 struct type_f64
 {
     auto to_hash() const { return hash(0); }
@@ -131,6 +173,15 @@ struct type_span
     auto operator==(const type_span&) const -> bool = default;
 };
 
+struct type_channel
+{
+    value_ptr<type_name> inner_type;
+
+    auto to_hash() const { return hash(inner_type); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_channel&) const -> bool = default;
+};
+
 struct type_function_ptr
 {
     std::vector<type_name> param_types;
@@ -176,6 +227,18 @@ struct type_function
     auto operator==(const type_function&) const -> bool = default;
 };
 
+// A host function registered with a native_registry
+struct type_native_function
+{
+    std::size_t            id;
+    std::vector<type_name> param_types;
+    value_ptr<type_name>   return_type;
+
+    auto to_hash() const { return hash(id, param_types, return_type); }
+    auto to_string() const -> std::string;
+    auto operator==(const type_native_function&) const -> bool = default;
+};
+
 struct type_function_template
 {
     std::filesystem::path    module;
@@ -211,9 +274,15 @@ struct type_name : public std::variant<
     type_null,
     type_bool,
     type_char,
+    type_i8,
+    type_i16,
     type_i32,
     type_i64,
+    type_u8,
+    type_u16,
+    type_u32,
     type_u64,
+    type_f32,
     type_f64,
     type_type,
     type_arena,
@@ -223,12 +292,14 @@ struct type_name : public std::variant<
     type_struct,
     type_ptr,
     type_span,
+    type_channel,
 
     type_function_ptr,
     type_bound_method,
     type_bound_method_template,
     
     type_function,
+    type_native_function,
     type_function_template,
     type_struct_template,
     type_placeholder>
@@ -273,9 +344,15 @@ struct const_value : public std::variant<
     std::monostate,        // no value, null
     bool,                  // bool
     char,                  // char
+    std::int8_t,           // i8
+    std::int16_t,          // i16
     std::int32_t,          // i32
     std::int64_t,          // i64
+    std::uint8_t,          // u8
+    std::uint16_t,         // u16
+    std::uint32_t,         // u32
     std::uint64_t,         // u64
+    float,                 // f32
     double,                // f64
     std::filesystem::path, // module
     type_name              // type
@@ -23,9 +23,13 @@ enum class precedence {
   logical_and, // and
   equality,    // == !=
   comparison,  // < > <= >=
+  bitwise_or,  // |
+  bitwise_xor, // ^
+  bitwise_and, // &
+  shift,       // << >>
   term,        // + -
   factor,      // * /
-  unary,       // ! -
+  unary,       // ! - ~
   call,        // . () [] !() @ const &
   scope,       // ::
   primary
@@ -66,6 +70,7 @@ auto new_node(const token& tok) -> std::tuple<node_expr_ptr, Inner&>
 
 auto parse_precedence(tokenstream& tokens, precedence prec) -> node_expr_ptr;
 auto get_rule(token_type tt) -> const parse_rule*;
+auto get_midfix_rule(const tokenstream& tokens) -> const parse_rule*;
 
 template <typename ExprType, token_type TokenType>
 auto parse_number(tokenstream& tokens) -> node_expr_ptr
@@ -80,6 +85,16 @@ auto parse_number(tokenstream& tokens) -> node_expr_ptr
     return node;
 }
 
+auto parse_i8(tokenstream& tokens) -> node_expr_ptr
+{
+    return parse_number<node_literal_i8_expr, token_type::int8>(tokens);
+}
+
+auto parse_i16(tokenstream& tokens) -> node_expr_ptr
+{
+    return parse_number<node_literal_i16_expr, token_type::int16>(tokens);
+}
+
 auto parse_i32(tokenstream& tokens) -> node_expr_ptr
 {
     return parse_number<node_literal_i32_expr, token_type::int32>(tokens);
@@ -90,11 +105,31 @@ auto parse_i64(tokenstream& tokens) -> node_expr_ptr
     return parse_number<node_literal_i64_expr, token_type::int64>(tokens);
 }
 
+auto parse_u8(tokenstream& tokens) -> node_expr_ptr
+{
+    return parse_number<node_literal_u8_expr, token_type::uint8>(tokens);
+}
+
+auto parse_u16(tokenstream& tokens) -> node_expr_ptr
+{
+    return parse_number<node_literal_u16_expr, token_type::uint16>(tokens);
+}
+
+auto parse_u32(tokenstream& tokens) -> node_expr_ptr
+{
+    return parse_number<node_literal_u32_expr, token_type::uint32>(tokens);
+}
+
 auto parse_u64(tokenstream& tokens) -> node_expr_ptr
 {
     return parse_number<node_literal_u64_expr, token_type::uint64>(tokens);
 }
 
+auto parse_f32(tokenstream& tokens) -> node_expr_ptr
+{
+    return parse_number<node_literal_f32_expr, token_type::float32>(tokens);
+}
+
 auto parse_f64(tokenstream& tokens) -> node_expr_ptr
 {
     return parse_number<node_literal_f64_expr, token_type::float64>(tokens);
@@ -232,8 +267,8 @@ auto parse_intrinsic(tokenstream& tokens) -> node_expr_ptr
 
 auto parse_binary(tokenstream& tokens, const node_expr_ptr& left) -> node_expr_ptr
 {
+    const auto rule = get_midfix_rule(tokens);
     const auto op = tokens.consume();
-    auto rule = get_rule(op.type);
     auto right = parse_precedence(tokens, precedence{std::to_underlying(rule->prec) + 1});
 
     auto [node, inner] = new_node<node_binary_op_expr>(op);
@@ -366,8 +401,8 @@ auto parse_precedence(tokenstream& tokens, precedence prec) -> node_expr_ptr
     token.assert(rule->prefix, "expected an expression");
 
     auto node = rule->prefix(tokens);
-    while (prec <= get_rule(tokens.curr().type)->prec) {
-        node = get_rule(tokens.curr().type)->midfix(tokens, node);
+    while (prec <= get_midfix_rule(tokens)->prec) {
+        node = get_midfix_rule(tokens)->midfix(tokens, node);
     }
     return node;
 }
@@ -381,9 +416,20 @@ static const auto rules = std::unordered_map<token_type, parse_rule>
     {token_type::slash,               {nullptr,             parse_binary,    precedence::factor}},
     {token_type::star,                {nullptr,             parse_binary,    precedence::factor}},
     {token_type::percent,             {nullptr,             parse_binary,    precedence::factor}},
+    {token_type::tilde,               {parse_unary,         nullptr,         precedence::none}},
+    {token_type::bar,                 {nullptr,             parse_binary,    precedence::bitwise_or}},
+    {token_type::caret,               {nullptr,             parse_binary,    precedence::bitwise_xor}},
+    {token_type::less_less,           {nullptr,             parse_binary,    precedence::shift}},
+    {token_type::greater_greater,     {nullptr,             parse_binary,    precedence::shift}},
+    {token_type::int8,                {parse_i8,            nullptr,         precedence::none}},
+    {token_type::int16,               {parse_i16,           nullptr,         precedence::none}},
     {token_type::int32,               {parse_i32,           nullptr,         precedence::none}},
     {token_type::int64,               {parse_i64,           nullptr,         precedence::none}},
+    {token_type::uint8,               {parse_u8,            nullptr,         precedence::none}},
+    {token_type::uint16,              {parse_u16,           nullptr,         precedence::none}},
+    {token_type::uint32,              {parse_u32,           nullptr,         precedence::none}},
     {token_type::uint64,              {parse_u64,           nullptr,         precedence::none}},
+    {token_type::float32,             {parse_f32,           nullptr,         precedence::none}},
     {token_type::float64,             {parse_f64,           nullptr,         precedence::none}},
     {token_type::character,           {parse_char,          nullptr,         precedence::none}},
     {token_type::kw_true,             {parse_true,          nullptr,         precedence::none}},
@@ -401,10 +447,16 @@ static const auto rules = std::unordered_map<token_type, parse_rule>
     {token_type::identifier,          {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_module,           {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_type,             {parse_name,          nullptr,         precedence::none}},
+    {token_type::kw_i8,               {parse_name,          nullptr,         precedence::none}},
+    {token_type::kw_i16,              {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_i32,              {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_i64,              {parse_name,          nullptr,         precedence::none}},
-    {token_type::kw_f64,              {parse_name,          nullptr,         precedence::none}},
+    {token_type::kw_u8,               {parse_name,          nullptr,         precedence::none}},
+    {token_type::kw_u16,              {parse_name,          nullptr,         precedence::none}},
+    {token_type::kw_u32,              {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_u64,              {parse_name,          nullptr,         precedence::none}},
+    {token_type::kw_f32,              {parse_name,          nullptr,         precedence::none}},
+    {token_type::kw_f64,              {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_char,             {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_bool,             {parse_name,          nullptr,         precedence::none}},
     {token_type::kw_null,             {parse_name,          nullptr,         precedence::none}},
@@ -427,6 +479,44 @@ auto get_rule(token_type tt) -> const parse_rule*
     return &default_rule;
 }
 
+auto starts_operand(token_type tt) -> bool
+{
+    switch (tt) {
+        case token_type::identifier:
+        case token_type::int8:
+        case token_type::int16:
+        case token_type::int32:
+        case token_type::int64:
+        case token_type::uint8:
+        case token_type::uint16:
+        case token_type::uint32:
+        case token_type::uint64:
+        case token_type::float32:
+        case token_type::float64:
+        case token_type::character:
+        case token_type::kw_true:
+        case token_type::kw_false:
+        case token_type::left_paren:
+        case token_type::minus:
+        case token_type::tilde:
+        case token_type::at:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// A trailing & takes the address of the expression before it, unless the next token starts
+// another operand, in which case it is a bitwise and
+auto get_midfix_rule(const tokenstream& tokens) -> const parse_rule*
+{
+    static constexpr auto bitwise_and = parse_rule{nullptr, parse_binary, precedence::bitwise_and};
+    if (tokens.curr().type == token_type::ampersand && starts_operand(tokens.next().type)) {
+        return &bitwise_and;
+    }
+    return get_rule(tokens.curr().type);
+}
+
 auto parse_expression(tokenstream& tokens) -> node_expr_ptr
 {
     return parse_precedence(tokens, precedence::as);
@@ -714,9 +804,14 @@ auto parse_top_level_statement(tokenstream& tokens) -> node_stmt_ptr
 }
 
 auto parse(const std::filesystem::path& file) -> anzu_module
+{
+    return parse(anzu::read_file(file));
+}
+
+auto parse(std::unique_ptr<std::string> source_code) -> anzu_module
 {
     auto new_module = anzu_module{};
-    new_module.source_code = anzu::read_file(file);
+    new_module.source_code = std::move(source_code);
     new_module.root = std::make_shared<node_stmt>();
     auto& seq = new_module.root->emplace<node_sequence_stmt>();
 
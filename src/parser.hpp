@@ -16,5 +16,6 @@ struct anzu_module
 };
 
 auto parse(const std::filesystem::path& file) -> anzu_module;
+auto parse(std::unique_ptr<std::string> source_code) -> anzu_module;
 
 }
\ No newline at end of file
@@ -1,17 +1,36 @@
 #include "runtime.hpp"
 #include "bytecode.hpp"
 #include "object.hpp"
+#include "utility/memory.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include <functional>
+#include <iterator>
+#include <limits>
 #include <utility>
 #include <format>
+#include <new>
 
 namespace anzu {
 namespace {
 
+// Set while a call is being evaluated at compile time. Faults must not take the compiler
+// down with them, so they unwind back to call_function_limited instead of panicking, which
+// then reports the call as one that cannot be evaluated.
+thread_local bool recoverable_faults = false;
+struct evaluation_fault {};
+
+// Stops compile time evaluation from exhausting the stack through deep recursion
+constexpr auto max_limited_frames = std::size_t{10'000};
+
 template <typename ...Args>
 [[noreturn]] auto runtime_error(std::format_string<Args...> message, Args&&... args)
 {
+    if (recoverable_faults) {
+        throw evaluation_fault{};
+    }
     const auto msg = std::format(message, std::forward<Args>(args)...);
     panic("runtime assertion failed! {}", msg);
 }
@@ -33,11 +52,77 @@ auto binary_op(bytecode_context& ctx) -> void
     ctx.stack.push(op(lhs, rhs));
 }
 
+// Integer division by zero and of the minimum value by -1 trap in hardware. These are only
+// checked when evaluating at compile time, where a fault must not crash the compiler.
+template <typename Type>
+auto check_division(Type lhs, Type rhs) -> void
+{
+    if (rhs == 0) {
+        runtime_error("division by zero");
+    }
+    if constexpr (std::is_signed_v<Type>) {
+        if (lhs == std::numeric_limits<Type>::min() && rhs == -1) {
+            runtime_error("{} / -1 overflows", lhs);
+        }
+    }
+}
+
+template <typename Type, template <typename> typename Op, bool Checked>
+auto division_op(bytecode_context& ctx) -> void
+{
+    static constexpr auto op = Op<Type>{};
+    const auto rhs = ctx.stack.pop<Type>();
+    const auto lhs = ctx.stack.pop<Type>();
+    if constexpr (Checked) check_division(lhs, rhs);
+    ctx.stack.push(op(lhs, rhs));
+}
+
+// Output from print statements goes to stdout unless the context is capturing it
+template <typename ...Args>
+auto program_print(bytecode_context& ctx, std::format_string<Args...> fmt, Args&&... args) -> void
+{
+    if (ctx.output) {
+        std::format_to(std::back_inserter(*ctx.output), fmt, std::forward<Args>(args)...);
+    } else {
+        std::print(fmt, std::forward<Args>(args)...);
+    }
+}
+
+// Function objects for binary_op and unary_op, these compile down to branchless code
+template <typename T>
+struct min_of { constexpr auto operator()(const T& lhs, const T& rhs) const -> T { return std::min(lhs, rhs); } };
+
+template <typename T>
+struct max_of { constexpr auto operator()(const T& lhs, const T& rhs) const -> T { return std::max(lhs, rhs); } };
+
+// Signed integers are negated as unsigned so that the minimum value wraps to itself, where
+// std::abs would be undefined
+template <typename T>
+struct abs_of
+{
+    constexpr auto operator()(const T& value) const -> T
+    {
+        if constexpr (std::is_integral_v<T>) {
+            using U = std::make_unsigned_t<T>;
+            return static_cast<T>(value < 0 ? U{0} - static_cast<U>(value) : static_cast<U>(value));
+        } else {
+            return std::abs(value);
+        }
+    }
+};
+
+template <typename From, typename To>
+auto convert_op(bytecode_context& ctx) -> void
+{
+    const auto obj = ctx.stack.pop<From>();
+    ctx.stack.push(static_cast<To>(obj));
+}
+
 template <typename Type>
 auto print_value(bytecode_context& ctx) -> void
 {
     const auto obj = ctx.stack.pop<Type>();
-    std::print("{}", obj);
+    program_print(ctx, "{}", obj);
 }
 
 template <typename T>
@@ -50,10 +135,309 @@ auto read_advance(bytecode_context& ctx) -> T
     return ret;
 }
 
+// As binary_op, but the right hand side is an immediate operand rather than on the stack
+template <typename Type, template <typename> typename Op>
+auto binary_imm_op(bytecode_context& ctx) -> void
+{
+    static constexpr auto op = Op<Type>{};
+    const auto rhs = read_advance<Type>(ctx);
+    const auto lhs = ctx.stack.pop<Type>();
+    ctx.stack.push(op(lhs, rhs));
+}
+
+template <typename Type, template <typename> typename Op, bool Checked>
+auto division_imm_op(bytecode_context& ctx) -> void
+{
+    static constexpr auto op = Op<Type>{};
+    const auto rhs = read_advance<Type>(ctx);
+    const auto lhs = ctx.stack.pop<Type>();
+    if constexpr (Checked) check_division(lhs, rhs);
+    ctx.stack.push(op(lhs, rhs));
+}
+
+// Sizes, offsets, jump targets and ids are stored narrowed, see encode_operands
+auto read_operand(bytecode_context& ctx) -> std::uint64_t
+{
+    return read_advance<bytecode_operand>(ctx);
+}
+
+// Indexing and pointers are not checked at runtime, so when evaluating at compile time every
+// address that is read or written is checked to be within memory owned by the context: the
+// live part of the stack, the rom or an arena.
+auto check_owned(bytecode_context& ctx, const std::byte* ptr, std::size_t size) -> void
+{
+    if (size == 0) return;
+    const auto address = reinterpret_cast<std::uintptr_t>(ptr);
+    const auto within = [&](const void* data, std::size_t length) {
+        const auto begin = reinterpret_cast<std::uintptr_t>(data);
+        return begin <= address && size <= length && address - begin <= length - size;
+    };
+    if (within(&ctx.stack.at(0), ctx.stack.size())) return;
+    if (within(ctx.rom.data(), ctx.rom.size())) return;
+    for (const auto& arena : ctx.arenas) {
+        if (within(arena->data.data(), arena->data.size())) return;
+    }
+    runtime_error("access of {} bytes at {} is out of bounds", size, static_cast<const void*>(ptr));
+}
+
+auto channel_cell(vm_channel* channel, std::size_t pos) -> std::byte*
+{
+    auto cells = reinterpret_cast<std::byte*>(channel) + sizeof(vm_channel);
+    return cells + (pos & channel->mask) * channel->cell_size;
+}
+
+auto cell_sequence(std::byte* cell) -> std::atomic<std::size_t>&
+{
+    return *std::launder(reinterpret_cast<std::atomic<std::size_t>*>(cell));
+}
+
+// std::atomic_ref needs an aligned object. Globals, struct fields and arena allocations are
+// always aligned, but locals are packed onto the stack.
+auto atomic_target(std::uint64_t* ptr) -> std::uint64_t*
+{
+    if (reinterpret_cast<std::uintptr_t>(ptr) % alignof(std::uint64_t) != 0) {
+        runtime_error("atomic operations need an 8-byte aligned address, got {}", static_cast<void*>(ptr));
+    }
+    return ptr;
+}
+
+// Pops the words of a bitset, which are laid out like a u64[]
+template <bool Limited>
+auto pop_bitset_words(bytecode_context& ctx) -> std::span<std::uint64_t>
+{
+    const auto length = ctx.stack.pop<std::uint64_t>();
+    const auto data = ctx.stack.pop<std::uint64_t*>();
+    if constexpr (Limited) {
+        check_owned(ctx, reinterpret_cast<const std::byte*>(data), length * sizeof(std::uint64_t));
+    }
+    return {data, length};
+}
+
+auto check_bit_index(std::span<const std::uint64_t> words, std::uint64_t size, std::uint64_t index) -> void
+{
+    if (index >= size || (index >> 6) >= words.size()) {
+        runtime_error("bitset index {} is out of range for a bitset of size {}", index, size);
+    }
+}
+
+auto check_same_words(std::span<const std::uint64_t> lhs, std::span<const std::uint64_t> rhs) -> void
+{
+    if (lhs.size() != rhs.size()) {
+        runtime_error("bitsets must be the same size, got {} and {} words", lhs.size(), rhs.size());
+    }
+}
+
+// Frames start at an 8-byte aligned address, since the stack itself is aligned, which lets
+// the compiler align the locals within them for the atomic intrinsics. Unaligned arguments
+// are moved up, and ret moves the return value back down to where the arguments started.
+auto push_frame(bytecode_context& ctx, std::uint64_t function_id, std::size_t args_size) -> void
+{
+    const auto args = ctx.stack.size() - args_size;
+    const auto padding = (alignof(std::uint64_t) - args % alignof(std::uint64_t)) % alignof(std::uint64_t);
+    if (padding > 0) {
+        ctx.stack.push_zero(padding);
+        std::memmove(&ctx.stack.at(args + padding), &ctx.stack.at(args), args_size);
+    }
+    ctx.frames.push_back(call_frame{
+        .code = ctx.functions[function_id].code.data(),
+        .ip = ctx.functions[function_id].code.data(),
+        .base_ptr = args + padding,
+        .padding = padding
+    });
+}
+
+// Reserves size bytes in the arena at an address that is a multiple of align, which must be
+// a power of two. Workers may be handed a pointer to the same arena, so the bump is atomic.
+auto arena_bump(memory_arena* arena, std::size_t align, std::size_t size) -> std::byte*
+{
+    const auto base = reinterpret_cast<std::uintptr_t>(arena->data.data());
+    auto next = arena->next.load(std::memory_order_relaxed);
+    while (true) {
+        const auto start = ((base + next + align - 1) & ~(align - 1)) - base;
+        if (start + size > arena->data.size()) {
+            runtime_error("arena overflow");
+        }
+        if (arena->next.compare_exchange_weak(next, start + size, std::memory_order_relaxed)) {
+            return &arena->data[start];
+        }
+    }
+}
+
+// Reserves size bytes in the arena. Type sizes are always a multiple of their alignment,
+// so the lowest set bit of the size (capped at 16) is enough to align every allocation.
+auto arena_reserve(memory_arena* arena, std::size_t type_size, std::size_t size) -> std::byte*
+{
+    const auto align = std::min(type_size & (~type_size + 1), std::size_t{16});
+    return arena_bump(arena, std::max(align, std::size_t{1}), size);
+}
+
+// Allocates a new channel in the given arena. Cells are padded so that every sequence
+// number is suitably aligned for atomic access.
+auto channel_new(memory_arena* arena, std::size_t value_size, std::size_t capacity) -> vm_channel*
+{
+    const auto count = std::bit_ceil(std::max(capacity, std::size_t{2}));
+    const auto cell_size = sizeof(std::size_t) + (value_size + 7) / 8 * 8;
+    const auto size = sizeof(vm_channel) + count * cell_size;
+
+    auto channel = new (arena_bump(arena, alignof(vm_channel), size)) vm_channel{};
+    channel->value_size = value_size;
+    channel->cell_size = cell_size;
+    channel->mask = count - 1;
+    channel->send_pos.store(0, std::memory_order_relaxed);
+    channel->recv_pos.store(0, std::memory_order_relaxed);
+    channel->sends.store(0, std::memory_order_relaxed);
+    channel->sleeping_receivers.store(0, std::memory_order_relaxed);
+    channel->receives.store(0, std::memory_order_relaxed);
+    channel->sleeping_senders.store(0, std::memory_order_relaxed);
+    for (std::size_t i = 0; i != count; ++i) {
+        new (channel_cell(channel, i)) std::atomic<std::size_t>{i};
+    }
+    return channel;
+}
+
+// Lock-free enqueue, returns false if the channel is full
+auto channel_try_send(vm_channel* channel, const std::byte* src) -> bool
+{
+    auto pos = channel->send_pos.load(std::memory_order_relaxed);
+    while (true) {
+        const auto cell = channel_cell(channel, pos);
+        const auto seq = cell_sequence(cell).load(std::memory_order_acquire);
+        const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+            if (channel->send_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                std::memcpy(cell + sizeof(std::size_t), src, channel->value_size);
+                cell_sequence(cell).store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = channel->send_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Lock-free dequeue, returns false if the channel is empty
+auto channel_try_recv(vm_channel* channel, std::byte* dst) -> bool
+{
+    auto pos = channel->recv_pos.load(std::memory_order_relaxed);
+    while (true) {
+        const auto cell = channel_cell(channel, pos);
+        const auto seq = cell_sequence(cell).load(std::memory_order_acquire);
+        const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (channel->recv_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                std::memcpy(dst, cell + sizeof(std::size_t), channel->value_size);
+                cell_sequence(cell).store(pos + channel->mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = channel->recv_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// The other side of a full or empty channel is usually about to act, so waiting starts by
+// yielding this many times before going to sleep
+constexpr auto channel_spins = 64;
+
+// Retries the given send or receive until it succeeds. Sleepers register themselves before
+// reading the counter and notifiers bump the counter before checking for sleepers, so one
+// of them always sees the other and no wake up is lost.
+template <typename TryOp>
+auto channel_wait(
+    std::atomic<std::uint32_t>& counter,
+    std::atomic<std::uint32_t>& sleeping,
+    TryOp&& try_op
+)
+    -> void
+{
+    for (int i = 0; i != channel_spins; ++i) {
+        if (try_op()) return;
+        std::this_thread::yield();
+    }
+    while (true) {
+        sleeping.fetch_add(1);
+        const auto seen = counter.load();
+        const auto done = try_op();
+        if (!done) counter.wait(seen);
+        sleeping.fetch_sub(1);
+        if (done) return;
+    }
+}
+
+auto channel_notify(std::atomic<std::uint32_t>& counter, std::atomic<std::uint32_t>& sleeping) -> void
+{
+    counter.fetch_add(1);
+    if (sleeping.load() != 0) counter.notify_all();
+}
+
+// When Limited, at most ctx.op_budget ops are executed before returning early
+template <bool Debug, bool Limited = false>
+auto execute_program(bytecode_context& ctx) -> void;
+
+// Calls the given function and stops once it returns, leaving the return value on the stack
+template <bool Debug, bool Limited = false>
+auto execute_function(bytecode_context& ctx, std::size_t function_id, std::span<const std::byte> args) -> void
+{
+    if (function_id >= ctx.functions.size()) {
+        runtime_error("invalid function id {}", function_id);
+    }
+    auto entry = std::vector<std::byte>{};
+    push_value(
+        entry,
+        op::call_static,
+        static_cast<bytecode_operand>(function_id),
+        static_cast<bytecode_operand>(args.size()),
+        op::end_program
+    );
+
+    ctx.stack.push(args.data(), args.size());
+    ctx.frames.emplace_back(call_frame{
+        .code = entry.data(),
+        .ip = entry.data(),
+        .base_ptr = 0
+    });
+    execute_program<Debug, Limited>(ctx);
+}
+
+auto join_workers(bytecode_context& ctx) -> std::exception_ptr;
+
+// Runs the given function on a fresh stack. The worker shares the functions, rom
+// and globals of the context that spawned it, and panics the same way it does.
 template <bool Debug>
+auto run_worker(
+    const bytecode_context& parent,
+    std::size_t function_id,
+    std::vector<std::byte> args,
+    bool throws,
+    std::exception_ptr& error
+)
+    -> void
+{
+    throw_panics = throws;
+    bytecode_context ctx{parent.functions, parent.natives, parent.rom};
+    ctx.globals = parent.globals;
+    ctx.args = parent.args;
+    ctx.frames.reserve(1000);
+    try {
+        execute_function<Debug>(ctx, function_id, args); // the return value is discarded with the stack
+        if (const auto worker_error = join_workers(ctx)) std::rethrow_exception(worker_error);
+    } catch (const panic_error&) {
+        error = std::current_exception();
+    }
+}
+
+template <bool Debug, bool Limited>
 auto execute_program(bytecode_context& ctx) -> void
 {
     while (true) {
+        if constexpr (Limited) {
+            if (ctx.op_budget == 0) return;
+            --ctx.op_budget;
+        }
         auto& frame = ctx.frames.back();
         if constexpr (Debug) {
             print_op(ctx.rom, frame.code, frame.ip);
@@ -61,25 +445,44 @@ auto execute_program(bytecode_context& ctx) -> void
         const auto op_code = read_advance<op>(ctx);
         switch (op_code) {
             case op::end_program: return;
+            case op::push_i8:
+            case op::push_u8:
             case op::push_char:
             case op::push_bool: {
                 ctx.stack.push(read_advance<std::uint8_t>(ctx));
             } break;
-            case op::push_i32: {
+            case op::push_i16:
+            case op::push_u16: {
+                ctx.stack.push(read_advance<std::uint16_t>(ctx));
+            } break;
+            case op::push_i32:
+            case op::push_u32:
+            case op::push_f32: {
                 ctx.stack.push(read_advance<std::uint32_t>(ctx));
             } break;
             case op::push_i64:
             case op::push_u64:
-            case op::push_f64:
-            case op::push_function_ptr: {
+            case op::push_f64: {
                 ctx.stack.push(read_advance<std::uint64_t>(ctx));
             } break;
+            case op::push_function_ptr: {
+                ctx.stack.push(read_operand(ctx));
+            } break;
             case op::push_string_literal: {
-                const auto index = read_advance<std::uint64_t>(ctx);
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto index = read_operand(ctx);
+                const auto size = read_operand(ctx);
                 ctx.stack.push(&ctx.rom[index]);
                 ctx.stack.push(size);
             } break;
+            case op::push_rom: {
+                const auto index = read_operand(ctx);
+                const auto size = read_operand(ctx);
+                ctx.stack.push(reinterpret_cast<const std::byte*>(&ctx.rom[index]), size);
+            } break;
+            case op::push_ptr_rom: {
+                const auto index = read_operand(ctx);
+                ctx.stack.push(&ctx.rom[index]);
+            } break;
             case op::push_null: {
                 ctx.stack.push(std::byte{0});
             } break;
@@ -87,71 +490,156 @@ auto execute_program(bytecode_context& ctx) -> void
                 ctx.stack.push(std::uint64_t{0});
             } break;
             case op::push_ptr_global: {
-                const auto offset = read_advance<std::uint64_t>(ctx);
-                std::byte* ptr = &ctx.stack.at(offset);
+                const auto offset = read_operand(ctx);
+                std::byte* ptr = ctx.globals + offset;
                 ctx.stack.push(ptr);
             } break;
             case op::push_ptr_local: {
-                const auto offset = read_advance<std::uint64_t>(ctx);
+                const auto offset = read_operand(ctx);
                 std::byte* ptr = &ctx.stack.at(frame.base_ptr + offset);
                 ctx.stack.push(ptr);
             } break;
             case op::push_val_global: {
-                const auto offset = read_advance<std::uint64_t>(ctx);
-                const auto size = read_advance<std::uint64_t>(ctx);
-                std::byte* ptr = &ctx.stack.at(offset);
+                const auto offset = read_operand(ctx);
+                const auto size = read_operand(ctx);
+                std::byte* ptr = ctx.globals + offset;
                 ctx.stack.push(ptr, size);
             } break;
             case op::push_val_local: {
-                const auto offset = read_advance<std::uint64_t>(ctx);
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto offset = read_operand(ctx);
+                const auto size = read_operand(ctx);
                 std::byte* ptr = &ctx.stack.at(frame.base_ptr + offset);
                 ctx.stack.push(ptr, size);
             } break;
+            case op::push_val_global_1: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<1>(ctx.globals + offset);
+            } break;
+            case op::push_val_global_4: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<4>(ctx.globals + offset);
+            } break;
+            case op::push_val_global_8: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<8>(ctx.globals + offset);
+            } break;
+            case op::push_val_global_16: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<16>(ctx.globals + offset);
+            } break;
+            case op::push_val_local_1: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<1>(&ctx.stack.at(frame.base_ptr + offset));
+            } break;
+            case op::push_val_local_4: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<4>(&ctx.stack.at(frame.base_ptr + offset));
+            } break;
+            case op::push_val_local_8: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<8>(&ctx.stack.at(frame.base_ptr + offset));
+            } break;
+            case op::push_val_local_16: {
+                const auto offset = read_operand(ctx);
+                ctx.stack.push_fixed<16>(&ctx.stack.at(frame.base_ptr + offset));
+            } break;
             case op::nth_element_ptr: {
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto size = read_operand(ctx);
                 const auto index = ctx.stack.pop<std::uint64_t>();
                 const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr + index * size, size);
                 ctx.stack.push(ptr + index * size);
             } break;
             case op::nth_element_val: {
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto size = read_operand(ctx);
                 const auto index = ctx.stack.pop<std::uint64_t>();
                 const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr + index * size, size);
                 ctx.stack.push(ptr + index * size, size);
             } break;
             case op::span_ptr_to_len: {
                 const std::byte* ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr + sizeof(std::byte*), sizeof(std::uint64_t));
                 ctx.stack.push(ptr + sizeof(std::byte*), sizeof(std::uint64_t));
             } break;
             case op::push_subspan: {
-                const auto type_size = read_advance<std::uint64_t>(ctx);
+                const auto type_size = read_operand(ctx);
                 const auto upper = ctx.stack.pop<std::uint64_t>();
                 const auto lower = ctx.stack.pop<std::uint64_t>();
                 const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) {
+                    if (lower > upper) runtime_error("invalid subspan [{}, {})", lower, upper);
+                    check_owned(ctx, ptr + type_size * lower, type_size * (upper - lower));
+                }
                 ctx.stack.push(ptr + type_size * lower);
                 ctx.stack.push(upper - lower);
             } break;
             case op::load: {
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto size = read_operand(ctx);
                 const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, size);
                 ctx.stack.push(ptr, size);
             } break;
             case op::save: {
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto size = read_operand(ctx);
                 const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, size);
                 ctx.stack.pop_and_save(ptr, size);
             } break;
+            case op::load_1: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 1);
+                ctx.stack.push_fixed<1>(ptr);
+            } break;
+            case op::load_4: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 4);
+                ctx.stack.push_fixed<4>(ptr);
+            } break;
+            case op::load_8: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 8);
+                ctx.stack.push_fixed<8>(ptr);
+            } break;
+            case op::load_16: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 16);
+                ctx.stack.push_fixed<16>(ptr);
+            } break;
+            case op::save_1: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 1);
+                ctx.stack.pop_and_save_fixed<1>(ptr);
+            } break;
+            case op::save_4: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 4);
+                ctx.stack.pop_and_save_fixed<4>(ptr);
+            } break;
+            case op::save_8: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 8);
+                ctx.stack.pop_and_save_fixed<8>(ptr);
+            } break;
+            case op::save_16: {
+                const auto ptr = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) check_owned(ctx, ptr, 16);
+                ctx.stack.pop_and_save_fixed<16>(ptr);
+            } break;
             case op::push: {
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto size = read_operand(ctx);
                 ctx.stack.resize(ctx.stack.size() + size);
             } break;
+            case op::push_zero: {
+                const auto size = read_operand(ctx);
+                ctx.stack.push_zero(size);
+            } break;
             case op::pop: {
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto size = read_operand(ctx);
                 ctx.stack.resize(ctx.stack.size() - size);
             } break;
             case op::memcpy: {
-                const auto type_size = read_advance<std::uint64_t>(ctx);
+                const auto type_size = read_operand(ctx);
                 const auto src_count = ctx.stack.pop<std::uint64_t>(); 
                 const auto src_data = ctx.stack.pop<std::byte*>();
                 const auto dst_count = ctx.stack.pop<std::uint64_t>(); 
@@ -159,20 +647,28 @@ auto execute_program(bytecode_context& ctx) -> void
                 if (dst_count < src_count) {
                     runtime_error("dst span too small to hold src span");
                 }
+                if constexpr (Limited) {
+                    check_owned(ctx, src_data, src_count * type_size);
+                    check_owned(ctx, dst_data, src_count * type_size);
+                }
                 std::memcpy(dst_data, src_data, src_count * type_size);
                 ctx.stack.push(std::byte{0}); // returns null;
             } break;
             case op::memcmp: {
-                const auto type_size = read_advance<std::uint64_t>(ctx); 
+                const auto type_size = read_operand(ctx); 
                 const auto rhs_data = ctx.stack.pop<std::byte*>();
                 const auto lhs_data = ctx.stack.pop<std::byte*>();
+                if constexpr (Limited) {
+                    check_owned(ctx, lhs_data, type_size);
+                    check_owned(ctx, rhs_data, type_size);
+                }
                 const bool equal = std::memcmp(lhs_data, rhs_data, type_size) == 0;
                 ctx.stack.push(equal); // returns null;
             } break;
             case op::arena_new: {
                 memory_arena* arena = nullptr;
                 if (ctx.arena_free_list.empty()) {
-                    ctx.arenas.push_back(std::make_unique<memory_arena>());
+                    ctx.arenas.push_back(std::make_unique_for_overwrite<memory_arena>());
                     arena = ctx.arenas.back().get();
                     arena->index = ctx.arenas.size() - 1;
                 } else {
@@ -180,7 +676,7 @@ auto execute_program(bytecode_context& ctx) -> void
                     ctx.arena_free_list.pop_back();
                     arena = ctx.arenas.at(index).get();
                 }
-                arena->next = 0;
+                arena->next.store(0, std::memory_order_relaxed);
                 ctx.stack.push(arena);
             } break;
             case op::arena_delete: {
@@ -189,98 +685,122 @@ auto execute_program(bytecode_context& ctx) -> void
             } break;
             case op::arena_alloc: {
                 auto arena = ctx.stack.pop<memory_arena*>();
-                const auto size = read_advance<std::uint64_t>(ctx);
-                if (arena->next + size > arena->data.size()) {
-                    runtime_error("arena overflow");
-                }
-                const auto data = &arena->data[arena->next];
-                arena->next += size;
+                const auto size = read_operand(ctx);
+                const auto data = arena_reserve(arena, size, size);
                 ctx.stack.pop_and_save(data, size);
                 ctx.stack.push(data);
             } break;
             case op::arena_alloc_array: {
-                const auto type_size = read_advance<std::uint64_t>(ctx);
+                const auto type_size = read_operand(ctx);
                 auto arena = ctx.stack.pop<memory_arena*>();
                 const auto count = ctx.stack.pop<std::uint64_t>();
-                const auto size = type_size * count;
-                if (arena->next + size > arena->data.size()) {
-                    runtime_error("arena overflow");
-                }
-                const auto data = &arena->data[arena->next];
+                const auto data = arena_reserve(arena, type_size, type_size * count);
                 for (size_t i = 0; i != count; ++i) {
                     ctx.stack.save(data + i * type_size, type_size);
                 }
                 ctx.stack.pop_n(type_size);
-                arena->next += size;
                 ctx.stack.push(data); // push the span (ptr + count)
                 ctx.stack.push(count);
             } break;
+            case op::arena_alloc_soa: {
+                // The element size of each field is on the stack below the count, and each
+                // is replaced in place by a span of zeroed elements. Spans are twice the size
+                // of the sizes, so they are written from the last field down to avoid
+                // overwriting sizes that have not been read yet.
+                const auto num_fields = read_operand(ctx);
+                auto arena = ctx.stack.pop<memory_arena*>();
+                const auto count = ctx.stack.pop<std::uint64_t>();
+                const auto base = ctx.stack.size() - num_fields * sizeof(std::uint64_t);
+                ctx.stack.push_zero(num_fields * sizeof(std::uint64_t));
+                for (auto i = num_fields; i-- != 0;) {
+                    auto size = std::uint64_t{};
+                    std::memcpy(&size, &ctx.stack.at(base + i * sizeof(std::uint64_t)), sizeof(size));
+                    const auto data = arena_reserve(arena, size, size * count);
+                    std::memset(data, 0, size * count);
+                    const auto span = &ctx.stack.at(base + i * (sizeof(std::byte*) + sizeof(std::uint64_t)));
+                    std::memcpy(span, &data, sizeof(std::byte*)); // the span (ptr + count)
+                    std::memcpy(span + sizeof(std::byte*), &count, sizeof(std::uint64_t));
+                }
+            } break;
             case op::arena_realloc_array: {
-                const auto type_size = read_advance<std::uint64_t>(ctx);
+                const auto type_size = read_operand(ctx);
                 const auto old_count = ctx.stack.pop<std::uint64_t>(); // this is the 
                 const auto old_data = ctx.stack.pop<std::byte*>();     // pushed span
                 auto arena = ctx.stack.pop<memory_arena*>();
                 const auto new_count = ctx.stack.pop<std::uint64_t>();
-                const auto size = type_size * new_count;
                 if (new_count <= old_count) {
                     runtime_error("invalid use of new, can only realloc to grow, old={} new={}", old_count, new_count);
                 }
-                if (arena->next + size > arena->data.size()) {
-                    runtime_error("arena overflow");
-                }
-                const auto new_data = &arena->data[arena->next];
+                if constexpr (Limited) check_owned(ctx, old_data, type_size * old_count);
+                const auto new_data = arena_reserve(arena, type_size, type_size * new_count);
                 std::memcpy(new_data, old_data, type_size * old_count);
                 for (size_t i = old_count; i != new_count; ++i) {
                     ctx.stack.save(new_data + i * type_size, type_size);
                 }
                 ctx.stack.pop_n(type_size);
-                arena->next += size;
                 ctx.stack.push(new_data); // push the span (ptr + count)
                 ctx.stack.push(new_count);
             } break;
             case op::arena_size: {
                 auto arena = ctx.stack.pop<memory_arena*>();
-                ctx.stack.push(arena->next);
+                ctx.stack.push(std::uint64_t{arena->next.load(std::memory_order_relaxed)});
             } break;
             case op::jump: {
-                const auto jump = read_advance<std::uint64_t>(ctx);
+                const auto jump = read_operand(ctx);
                 frame.ip = &frame.code[jump];
             } break;
             case op::jump_if_true: {
-                const auto jump = read_advance<std::uint64_t>(ctx);
+                const auto jump = read_operand(ctx);
                 if (ctx.stack.pop<bool>()) frame.ip = &frame.code[jump];
             } break;
             case op::jump_if_false: {
-                const auto jump = read_advance<std::uint64_t>(ctx);
+                const auto jump = read_operand(ctx);
                 if (!ctx.stack.pop<bool>()) frame.ip = &frame.code[jump];
             } break;
             case op::ret: {
-                const auto size = read_advance<std::uint64_t>(ctx);
-                std::memcpy(&ctx.stack.at(frame.base_ptr), &ctx.stack.at(ctx.stack.size() - size), size);
-                ctx.stack.resize(frame.base_ptr + size);
+                const auto size = read_operand(ctx);
+                const auto dst = frame.base_ptr - frame.padding;
+                std::memmove(&ctx.stack.at(dst), &ctx.stack.at(ctx.stack.size() - size), size);
+                ctx.stack.resize(dst + size);
+                ctx.frames.pop_back();
+            } break;
+            case op::ret_local: {
+                const auto offset = read_operand(ctx);
+                const auto size = read_operand(ctx);
+                const auto dst = frame.base_ptr - frame.padding;
+                std::memmove(&ctx.stack.at(dst), &ctx.stack.at(frame.base_ptr + offset), size);
+                ctx.stack.resize(dst + size);
                 ctx.frames.pop_back();
             } break;
             case op::call_static: {
-                const auto function_id = read_advance<std::uint64_t>(ctx);
-                const auto args_size = read_advance<std::uint64_t>(ctx);
-                ctx.frames.push_back(call_frame{
-                    .code = ctx.functions[function_id].code.data(),
-                    .ip = ctx.functions[function_id].code.data(),
-                    .base_ptr = ctx.stack.size() - args_size
-                });
+                const auto function_id = read_operand(ctx);
+                const auto args_size = read_operand(ctx);
+                if constexpr (Limited) {
+                    if (ctx.frames.size() >= max_limited_frames) runtime_error("call depth exceeded");
+                }
+                push_frame(ctx, function_id, args_size);
+            } break;
+            case op::call_native: {
+                const auto id = read_operand(ctx);
+                const auto args_size = read_operand(ctx);
+                const auto return_size = read_operand(ctx);
+                const auto base = ctx.stack.size() - args_size;
+                ctx.natives[id].ptr(&ctx.stack.at(base), &ctx.stack.at(base));
+                ctx.stack.resize(base + return_size);
             } break;
             case op::call_ptr: {
-                const auto args_size = read_advance<std::uint64_t>(ctx);
+                const auto args_size = read_operand(ctx);
+                const auto return_size = read_operand(ctx);
                 const auto function_id = ctx.stack.pop<std::uint64_t>();
-                ctx.frames.push_back(call_frame{
-                    .code = ctx.functions[function_id].code.data(),
-                    .ip = ctx.functions[function_id].code.data(),
-                    .base_ptr = ctx.stack.size() - args_size
-                });
+                // The callee is only known now, so this is the one call the verifier cannot check
+                if (function_id >= ctx.functions.size() || ctx.functions[function_id].return_size != return_size) {
+                    runtime_error("call through a function pointer to {} does not match its signature", function_id);
+                }
+                push_frame(ctx, function_id, args_size);
             } break;
             case op::assert: {
-                const auto index = read_advance<std::uint64_t>(ctx);
-                const auto size = read_advance<std::uint64_t>(ctx);
+                const auto index = read_operand(ctx);
+                const auto size = read_operand(ctx);
                 if (!ctx.stack.pop<bool>()) {
                     const auto data = &ctx.rom[index];
                     runtime_error("{}", std::string_view{data, size});
@@ -294,30 +814,105 @@ auto execute_program(bytecode_context& ctx) -> void
                 const auto file = std::string{filename_data, filename_size};
                 const auto handle = std::fopen(file.c_str(), "rb");
                 if (!handle) {
-                    std::print("failed to open\n");
-                    std::exit(1);
+                    runtime_error("failed to open '{}'", file);
                 }
                 std::fseek(handle, 0, SEEK_END);
                 const auto ssize = std::ftell(handle);
                 if (ssize == -1) {
-                    std::print("Error with ftell\n");
-                    std::exit(1);
+                    std::fclose(handle);
+                    runtime_error("failed to find the size of '{}'", file);
                 }
                 const auto size = static_cast<std::size_t>(ssize);
                 std::rewind(handle);
-                std::byte* ptr = &arena->data[arena->next];
+                std::byte* ptr = arena_bump(arena, 1, size);
                 const auto bytes_read = std::fread(ptr, sizeof(std::byte), ssize, handle);
                 if (bytes_read != ssize) {
-                    std::print("Error with fread\n");
-                    std::exit(1);
-                }	
-                arena->next += size;
+                    std::fclose(handle);
+                    runtime_error("failed to read '{}'", file);
+                }
 
                 std::fclose(handle);
                 ctx.stack.push(ptr);  // push the
                 ctx.stack.push(size); // span
             } break;
 
+            case op::channel_new: {
+                const auto value_size = read_operand(ctx);
+                auto arena = ctx.stack.pop<memory_arena*>();
+                const auto capacity = ctx.stack.pop<std::uint64_t>();
+                ctx.stack.push(channel_new(arena, value_size, capacity));
+            } break;
+            case op::channel_send: {
+                const auto size = read_operand(ctx);
+                const auto value = &ctx.stack.at(ctx.stack.size() - size);
+                vm_channel* channel = nullptr;
+                std::memcpy(&channel, value - sizeof(vm_channel*), sizeof(vm_channel*));
+                channel_wait(channel->receives, channel->sleeping_senders, [&] {
+                    return channel_try_send(channel, value); // fails if full, wait for a receiver
+                });
+                channel_notify(channel->sends, channel->sleeping_receivers);
+                ctx.stack.pop_n(size + sizeof(vm_channel*));
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+            case op::channel_recv: {
+                const auto size = read_operand(ctx);
+                const auto channel = ctx.stack.pop<vm_channel*>();
+                const auto dst = ctx.stack.size();
+                ctx.stack.resize(dst + size);
+                channel_wait(channel->sends, channel->sleeping_receivers, [&] {
+                    return channel_try_recv(channel, &ctx.stack.at(dst)); // fails if empty, wait for a sender
+                });
+                channel_notify(channel->receives, channel->sleeping_senders);
+            } break;
+            case op::spawn: {
+                const auto function_id = read_operand(ctx);
+                const auto args_size = read_operand(ctx);
+                const auto args_start = &ctx.stack.at(ctx.stack.size() - args_size);
+                auto args = std::vector<std::byte>(args_start, args_start + args_size);
+                ctx.stack.pop_n(args_size);
+                auto& error = ctx.worker_errors.emplace_back();
+                ctx.workers.emplace_back(run_worker<Debug>, std::cref(ctx), function_id, std::move(args), throw_panics, std::ref(error));
+                ctx.stack.push(std::uint64_t{ctx.workers.size() - 1}); // handle to the worker
+            } break;
+            case op::join: {
+                const auto handle = ctx.stack.pop<std::uint64_t>();
+                if (handle >= ctx.workers.size()) {
+                    runtime_error("invalid worker handle {}", handle);
+                }
+                if (ctx.workers[handle].joinable()) {
+                    ctx.workers[handle].join();
+                }
+                if (const auto error = std::exchange(ctx.worker_errors[handle], nullptr)) {
+                    std::rethrow_exception(error);
+                }
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+            case op::push_args: {
+                ctx.stack.push(ctx.args.data());
+                ctx.stack.push(std::uint64_t{ctx.args.size()});
+            } break;
+            case op::atomic_load: {
+                const auto ptr = atomic_target(ctx.stack.pop<std::uint64_t*>());
+                ctx.stack.push(std::atomic_ref{*ptr}.load());
+            } break;
+            case op::atomic_store: {
+                const auto value = ctx.stack.pop<std::uint64_t>();
+                const auto ptr = atomic_target(ctx.stack.pop<std::uint64_t*>());
+                std::atomic_ref{*ptr}.store(value);
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+            case op::atomic_add: { // i64 and u64 share this since addition wraps identically
+                const auto value = ctx.stack.pop<std::uint64_t>();
+                const auto ptr = atomic_target(ctx.stack.pop<std::uint64_t*>());
+                ctx.stack.push(std::atomic_ref{*ptr}.fetch_add(value));
+            } break;
+            case op::atomic_cas: {
+                const auto desired = ctx.stack.pop<std::uint64_t>();
+                auto expected = ctx.stack.pop<std::uint64_t>();
+                const auto ptr = atomic_target(ctx.stack.pop<std::uint64_t*>());
+                ctx.stack.push(std::atomic_ref{*ptr}.compare_exchange_strong(expected, desired));
+            } break;
+
             case op::null_to_i64: {
                 const auto value = ctx.stack.pop<std::byte>();
                 ctx.stack.push(std::int64_t{0});
@@ -368,14 +963,28 @@ auto execute_program(bytecode_context& ctx) -> void
                 ctx.stack.push(static_cast<std::uint64_t>(value));
             } break;
 
+            case op::i8_to_i64:  { convert_op<std::int8_t, std::int64_t>(ctx); } break;
+            case op::i16_to_i64: { convert_op<std::int16_t, std::int64_t>(ctx); } break;
+            case op::u8_to_u64:  { convert_op<std::uint8_t, std::uint64_t>(ctx); } break;
+            case op::u16_to_u64: { convert_op<std::uint16_t, std::uint64_t>(ctx); } break;
+            case op::u32_to_u64: { convert_op<std::uint32_t, std::uint64_t>(ctx); } break;
+            case op::f32_to_f64: { convert_op<float, double>(ctx); } break;
+            case op::i64_to_i8:  { convert_op<std::int64_t, std::int8_t>(ctx); } break;
+            case op::i64_to_i16: { convert_op<std::int64_t, std::int16_t>(ctx); } break;
+            case op::u64_to_u8:  { convert_op<std::uint64_t, std::uint8_t>(ctx); } break;
+            case op::u64_to_u16: { convert_op<std::uint64_t, std::uint16_t>(ctx); } break;
+            case op::u64_to_u32: { convert_op<std::uint64_t, std::uint32_t>(ctx); } break;
+            case op::f64_to_f32: { convert_op<double, float>(ctx); } break;
+            case op::i64_to_i32: { convert_op<std::int64_t, std::int32_t>(ctx); } break;
+
             case op::char_eq: { binary_op<char, std::equal_to>(ctx); } break;
             case op::char_ne: { binary_op<char, std::not_equal_to>(ctx); } break;
 
             case op::i32_add: { binary_op<std::int32_t, std::plus>(ctx); } break;
             case op::i32_sub: { binary_op<std::int32_t, std::minus>(ctx); } break;
             case op::i32_mul: { binary_op<std::int32_t, std::multiplies>(ctx); } break;
-            case op::i32_div: { binary_op<std::int32_t, std::divides>(ctx); } break;
-            case op::i32_mod: { binary_op<std::int32_t, std::modulus>(ctx); } break;
+            case op::i32_div: { division_op<std::int32_t, std::divides, Limited>(ctx); } break;
+            case op::i32_mod: { division_op<std::int32_t, std::modulus, Limited>(ctx); } break;
             case op::i32_eq:  { binary_op<std::int32_t, std::equal_to>(ctx); } break;
             case op::i32_ne:  { binary_op<std::int32_t, std::not_equal_to>(ctx); } break;
             case op::i32_lt:  { binary_op<std::int32_t, std::less>(ctx); } break;
@@ -386,8 +995,8 @@ auto execute_program(bytecode_context& ctx) -> void
             case op::i64_add: { binary_op<std::int64_t, std::plus>(ctx); } break;
             case op::i64_sub: { binary_op<std::int64_t, std::minus>(ctx); } break;
             case op::i64_mul: { binary_op<std::int64_t, std::multiplies>(ctx); } break;
-            case op::i64_div: { binary_op<std::int64_t, std::divides>(ctx); } break;
-            case op::i64_mod: { binary_op<std::int64_t, std::modulus>(ctx); } break;
+            case op::i64_div: { division_op<std::int64_t, std::divides, Limited>(ctx); } break;
+            case op::i64_mod: { division_op<std::int64_t, std::modulus, Limited>(ctx); } break;
             case op::i64_eq:  { binary_op<std::int64_t, std::equal_to>(ctx); } break;
             case op::i64_ne:  { binary_op<std::int64_t, std::not_equal_to>(ctx); } break;
             case op::i64_lt:  { binary_op<std::int64_t, std::less>(ctx); } break;
@@ -398,8 +1007,8 @@ auto execute_program(bytecode_context& ctx) -> void
             case op::u64_add: { binary_op<std::uint64_t, std::plus>(ctx); } break;
             case op::u64_sub: { binary_op<std::uint64_t, std::minus>(ctx); } break;
             case op::u64_mul: { binary_op<std::uint64_t, std::multiplies>(ctx); } break;
-            case op::u64_div: { binary_op<std::uint64_t, std::divides>(ctx); } break;
-            case op::u64_mod: { binary_op<std::uint64_t, std::modulus>(ctx); } break;
+            case op::u64_div: { division_op<std::uint64_t, std::divides, Limited>(ctx); } break;
+            case op::u64_mod: { division_op<std::uint64_t, std::modulus, Limited>(ctx); } break;
             case op::u64_eq:  { binary_op<std::uint64_t, std::equal_to>(ctx); } break;
             case op::u64_ne:  { binary_op<std::uint64_t, std::not_equal_to>(ctx); } break;
             case op::u64_lt:  { binary_op<std::uint64_t, std::less>(ctx); } break;
@@ -407,6 +1016,30 @@ auto execute_program(bytecode_context& ctx) -> void
             case op::u64_gt:  { binary_op<std::uint64_t, std::greater>(ctx); } break;
             case op::u64_ge:  { binary_op<std::uint64_t, std::greater_equal>(ctx); } break;
 
+            case op::i64_add_imm: { binary_imm_op<std::int64_t, std::plus>(ctx); } break;
+            case op::i64_sub_imm: { binary_imm_op<std::int64_t, std::minus>(ctx); } break;
+            case op::i64_mul_imm: { binary_imm_op<std::int64_t, std::multiplies>(ctx); } break;
+            case op::i64_div_imm: { division_imm_op<std::int64_t, std::divides, Limited>(ctx); } break;
+            case op::i64_mod_imm: { division_imm_op<std::int64_t, std::modulus, Limited>(ctx); } break;
+            case op::i64_eq_imm:  { binary_imm_op<std::int64_t, std::equal_to>(ctx); } break;
+            case op::i64_ne_imm:  { binary_imm_op<std::int64_t, std::not_equal_to>(ctx); } break;
+            case op::i64_lt_imm:  { binary_imm_op<std::int64_t, std::less>(ctx); } break;
+            case op::i64_le_imm:  { binary_imm_op<std::int64_t, std::less_equal>(ctx); } break;
+            case op::i64_gt_imm:  { binary_imm_op<std::int64_t, std::greater>(ctx); } break;
+            case op::i64_ge_imm:  { binary_imm_op<std::int64_t, std::greater_equal>(ctx); } break;
+
+            case op::u64_add_imm: { binary_imm_op<std::uint64_t, std::plus>(ctx); } break;
+            case op::u64_sub_imm: { binary_imm_op<std::uint64_t, std::minus>(ctx); } break;
+            case op::u64_mul_imm: { binary_imm_op<std::uint64_t, std::multiplies>(ctx); } break;
+            case op::u64_div_imm: { division_imm_op<std::uint64_t, std::divides, Limited>(ctx); } break;
+            case op::u64_mod_imm: { division_imm_op<std::uint64_t, std::modulus, Limited>(ctx); } break;
+            case op::u64_eq_imm:  { binary_imm_op<std::uint64_t, std::equal_to>(ctx); } break;
+            case op::u64_ne_imm:  { binary_imm_op<std::uint64_t, std::not_equal_to>(ctx); } break;
+            case op::u64_lt_imm:  { binary_imm_op<std::uint64_t, std::less>(ctx); } break;
+            case op::u64_le_imm:  { binary_imm_op<std::uint64_t, std::less_equal>(ctx); } break;
+            case op::u64_gt_imm:  { binary_imm_op<std::uint64_t, std::greater>(ctx); } break;
+            case op::u64_ge_imm:  { binary_imm_op<std::uint64_t, std::greater_equal>(ctx); } break;
+
             case op::f64_add: { binary_op<double, std::plus>(ctx); } break;
             case op::f64_sub: { binary_op<double, std::minus>(ctx); } break;
             case op::f64_mul: { binary_op<double, std::multiplies>(ctx); } break;
@@ -418,6 +1051,135 @@ auto execute_program(bytecode_context& ctx) -> void
             case op::f64_gt:  { binary_op<double, std::greater>(ctx); } break;
             case op::f64_ge:  { binary_op<double, std::greater_equal>(ctx); } break;
 
+            case op::u64_and: { binary_op<std::uint64_t, std::bit_and>(ctx); } break;
+            case op::u64_or:  { binary_op<std::uint64_t, std::bit_or>(ctx); } break;
+            case op::u64_xor: { binary_op<std::uint64_t, std::bit_xor>(ctx); } break;
+            case op::u64_not: { unary_op<std::uint64_t, std::bit_not>(ctx); } break;
+            // Shift amounts wrap at 64 rather than being undefined behaviour
+            case op::u64_shl: {
+                const auto rhs = ctx.stack.pop<std::uint64_t>();
+                const auto lhs = ctx.stack.pop<std::uint64_t>();
+                ctx.stack.push(lhs << (rhs & 63));
+            } break;
+            case op::u64_shr: {
+                const auto rhs = ctx.stack.pop<std::uint64_t>();
+                const auto lhs = ctx.stack.pop<std::uint64_t>();
+                ctx.stack.push(lhs >> (rhs & 63));
+            } break;
+            case op::i64_shr: {
+                const auto rhs = ctx.stack.pop<std::int64_t>();
+                const auto lhs = ctx.stack.pop<std::int64_t>();
+                ctx.stack.push(lhs >> (rhs & 63));
+            } break;
+            case op::u64_popcount: {
+                const auto value = ctx.stack.pop<std::uint64_t>();
+                ctx.stack.push(static_cast<std::uint64_t>(std::popcount(value)));
+            } break;
+            case op::u64_ctz: {
+                const auto value = ctx.stack.pop<std::uint64_t>();
+                ctx.stack.push(static_cast<std::uint64_t>(std::countr_zero(value)));
+            } break;
+            case op::u64_clz: {
+                const auto value = ctx.stack.pop<std::uint64_t>();
+                ctx.stack.push(static_cast<std::uint64_t>(std::countl_zero(value)));
+            } break;
+            case op::u64_rotl: {
+                const auto count = ctx.stack.pop<std::uint64_t>();
+                const auto value = ctx.stack.pop<std::uint64_t>();
+                ctx.stack.push(std::rotl(value, static_cast<int>(count & 63)));
+            } break;
+            case op::bits_set: {
+                const auto index = ctx.stack.pop<std::uint64_t>();
+                const auto size = ctx.stack.pop<std::uint64_t>();
+                const auto words = pop_bitset_words<Limited>(ctx);
+                check_bit_index(words, size, index);
+                words[index >> 6] |= std::uint64_t{1} << (index & 63);
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+            case op::bits_clear: {
+                const auto index = ctx.stack.pop<std::uint64_t>();
+                const auto size = ctx.stack.pop<std::uint64_t>();
+                const auto words = pop_bitset_words<Limited>(ctx);
+                check_bit_index(words, size, index);
+                words[index >> 6] &= ~(std::uint64_t{1} << (index & 63));
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+            case op::bits_test: {
+                const auto index = ctx.stack.pop<std::uint64_t>();
+                const auto size = ctx.stack.pop<std::uint64_t>();
+                const auto words = pop_bitset_words<Limited>(ctx);
+                check_bit_index(words, size, index);
+                ctx.stack.push(static_cast<bool>((words[index >> 6] >> (index & 63)) & 1));
+            } break;
+            case op::bits_count: {
+                const auto words = pop_bitset_words<Limited>(ctx);
+                auto total = std::uint64_t{0};
+                for (const auto word : words) total += std::popcount(word);
+                ctx.stack.push(total);
+            } break;
+            case op::bits_find_next: { // returns the size if there is no set bit at or after start
+                const auto start = ctx.stack.pop<std::uint64_t>();
+                const auto size = ctx.stack.pop<std::uint64_t>();
+                const auto words = pop_bitset_words<Limited>(ctx);
+                auto result = size;
+                if (start < size && (start >> 6) < words.size()) {
+                    auto word = start >> 6;
+                    auto bits = words[word] & (~std::uint64_t{0} << (start & 63));
+                    while (bits == 0 && ++word < words.size()) bits = words[word];
+                    if (bits != 0) result = std::min((word << 6) + std::countr_zero(bits), size);
+                }
+                ctx.stack.push(result);
+            } break;
+            case op::bits_and: {
+                const auto src = pop_bitset_words<Limited>(ctx);
+                const auto dst = pop_bitset_words<Limited>(ctx);
+                check_same_words(dst, src);
+                for (std::size_t i = 0; i != dst.size(); ++i) dst[i] &= src[i];
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+            case op::bits_or: {
+                const auto src = pop_bitset_words<Limited>(ctx);
+                const auto dst = pop_bitset_words<Limited>(ctx);
+                check_same_words(dst, src);
+                for (std::size_t i = 0; i != dst.size(); ++i) dst[i] |= src[i];
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+            case op::bits_xor: {
+                const auto src = pop_bitset_words<Limited>(ctx);
+                const auto dst = pop_bitset_words<Limited>(ctx);
+                check_same_words(dst, src);
+                for (std::size_t i = 0; i != dst.size(); ++i) dst[i] ^= src[i];
+                ctx.stack.push(std::byte{0}); // returns null
+            } break;
+
+            case op::f64_sqrt:  { ctx.stack.push(std::sqrt(ctx.stack.pop<double>())); } break;
+            case op::f64_floor: { ctx.stack.push(std::floor(ctx.stack.pop<double>())); } break;
+            case op::f64_ceil:  { ctx.stack.push(std::ceil(ctx.stack.pop<double>())); } break;
+            case op::f64_round: { ctx.stack.push(std::round(ctx.stack.pop<double>())); } break;
+            case op::f64_exp:   { ctx.stack.push(std::exp(ctx.stack.pop<double>())); } break;
+            case op::f64_log:   { ctx.stack.push(std::log(ctx.stack.pop<double>())); } break;
+            case op::f64_sin:   { ctx.stack.push(std::sin(ctx.stack.pop<double>())); } break;
+            case op::f64_cos:   { ctx.stack.push(std::cos(ctx.stack.pop<double>())); } break;
+            case op::f64_tan:   { ctx.stack.push(std::tan(ctx.stack.pop<double>())); } break;
+            case op::f64_pow: {
+                const auto exponent = ctx.stack.pop<double>();
+                const auto base = ctx.stack.pop<double>();
+                ctx.stack.push(std::pow(base, exponent));
+            } break;
+            case op::f64_atan2: {
+                const auto x = ctx.stack.pop<double>();
+                const auto y = ctx.stack.pop<double>();
+                ctx.stack.push(std::atan2(y, x));
+            } break;
+            case op::i64_min: { binary_op<std::int64_t, min_of>(ctx); } break;
+            case op::i64_max: { binary_op<std::int64_t, max_of>(ctx); } break;
+            case op::u64_min: { binary_op<std::uint64_t, min_of>(ctx); } break;
+            case op::u64_max: { binary_op<std::uint64_t, max_of>(ctx); } break;
+            case op::f64_min: { binary_op<double, min_of>(ctx); } break;
+            case op::f64_max: { binary_op<double, max_of>(ctx); } break;
+            case op::i64_abs: { unary_op<std::int64_t, abs_of>(ctx); } break;
+            case op::f64_abs: { unary_op<double, abs_of>(ctx); } break;
+
             case op::bool_eq:  { binary_op<bool, std::equal_to>(ctx); } break;
             case op::bool_ne:  { binary_op<bool, std::not_equal_to>(ctx); } break;
             case op::bool_not: { unary_op<bool, std::logical_not>(ctx); } break;
@@ -428,40 +1190,55 @@ auto execute_program(bytecode_context& ctx) -> void
 
             case op::print_null: {
                 ctx.stack.pop<std::byte>(); // pops the null byte
-                std::print("null");
+                program_print(ctx, "null");
             } break;
             case op::print_bool: {
                 const auto b = ctx.stack.pop<bool>();
-                std::print("{}", b ? "true" : "false");
+                program_print(ctx, "{}", b ? "true" : "false");
             } break;
             case op::print_char: {
                 const auto c = ctx.stack.pop<char>();
-                std::print("{}", c);
+                program_print(ctx, "{}", c);
             } break;
             case op::print_i32: { print_value<std::int32_t>(ctx); } break;
             case op::print_i64: { print_value<std::int64_t>(ctx); } break;
             case op::print_u64: { print_value<std::uint64_t>(ctx); } break;
+            case op::print_f32: { print_value<float>(ctx); } break;
             case op::print_f64: { print_value<double>(ctx); } break;
             case op::print_char_span: {
                 const auto size = ctx.stack.pop<std::uint64_t>();
                 const auto ptr = ctx.stack.pop<const char*>();
-                std::print("{}", std::string_view{ptr, size});
+                program_print(ctx, "{}", std::string_view{ptr, size});
             } break;
             case op::print_ptr: {
                 const auto ptr = ctx.stack.pop<std::uint64_t>();
-                std::print("{:#018x}", ptr);
+                program_print(ctx, "{:#018x}", ptr);
             } break; 
 
-            default: { runtime_error("unknown op code! ({})", static_cast<int>(op_code)); } break;
+            default: { std::unreachable(); } // op codes are checked by the verifier
         }
     }
 }
 
+// Waits for every worker and returns the first panic raised by one of them, if any
+auto join_workers(bytecode_context& ctx) -> std::exception_ptr
+{
+    for (auto& worker : ctx.workers) {
+        if (worker.joinable()) worker.join();
+    }
+    ctx.workers.clear();
+    auto error = std::exception_ptr{};
+    for (const auto& worker_error : ctx.worker_errors) {
+        if (worker_error && !error) error = worker_error;
+    }
+    ctx.worker_errors.clear();
+    return error;
+}
+
 template <bool Debug>
-auto run(const bytecode_program& prog) -> void
+auto run(bytecode_context& ctx) -> void
 {
-    bytecode_context ctx{prog.functions, prog.rom};
-    ctx.frames.reserve(1000);
+    reset_context(ctx);
     ctx.frames.emplace_back(call_frame{
         .code = ctx.functions.front().code.data(),
         .ip = ctx.functions.front().code.data(),
@@ -469,12 +1246,33 @@ auto run(const bytecode_program& prog) -> void
     });
 
     execute_program<Debug>(ctx);
+    if (const auto error = join_workers(ctx)) std::rethrow_exception(error);
 
     if (ctx.stack.size() > 0) {
         std::print("\n -> Stack Size: {}, bug in the compiler!\n", ctx.stack.size());
     }
 }
 
+template <bool Debug>
+auto call(
+    bytecode_context& ctx,
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::span<std::byte> result
+)
+    -> void
+{
+    reset_context(ctx);
+
+    execute_function<Debug>(ctx, function_id, args);
+    if (const auto error = join_workers(ctx)) std::rethrow_exception(error);
+
+    if (ctx.stack.size() != result.size()) {
+        runtime_error("function {} returned {} bytes, expected {}", function_id, ctx.stack.size(), result.size());
+    }
+    ctx.stack.pop_and_save(result.data(), result.size());
+}
+
 }
 
 vm_stack::vm_stack(std::size_t size)
@@ -483,28 +1281,38 @@ vm_stack::vm_stack(std::size_t size)
     , d_current_size{0}
 {}
 
+auto vm_stack::overflow(std::size_t count) const -> void
+{
+    runtime_error("stack overflow (current_size={}, count={}, max_size={})", d_current_size, count, d_max_size);
+}
+
 auto vm_stack::push(const std::byte* src, std::size_t count) -> void
 {
     if (d_current_size + count > d_max_size) {
-        std::print("Stack overflow (current_size={}, count={}, max_size={}\n", d_current_size, count, d_max_size);
-        std::exit(27);
+        overflow(count);
     }
     std::memcpy(&d_data[d_current_size], src, count);
     d_current_size += count;
 }
 
+auto vm_stack::push_zero(std::size_t count) -> void
+{
+    if (d_current_size + count > d_max_size) {
+        overflow(count);
+    }
+    std::memset(&d_data[d_current_size], 0, count);
+    d_current_size += count;
+}
+
 auto vm_stack::pop_and_save(std::byte* dst, std::size_t count) -> void
 {
     save(dst, count);
     d_current_size -= count;
 }
 
+// The verifier guarantees no op pops more than its frame has pushed
 auto vm_stack::save(std::byte* dst, std::size_t count) -> void
 {
-    if (d_current_size < count) {
-        std::print("Stack underflow\n");
-        std::exit(28);
-    }
     std::memcpy(dst, &d_data[d_current_size - count], count);
 }
 
@@ -523,12 +1331,78 @@ auto vm_stack::print() const -> void
 
 auto run_program(const bytecode_program& prog) -> void
 {
-    run<false>(prog);
+    auto ctx = bytecode_context{prog.functions, prog.natives, prog.rom};
+    run<false>(ctx);
 }
 
 auto run_program_debug(const bytecode_program& prog) -> void
 {
-    run<true>(prog);
+    auto ctx = bytecode_context{prog.functions, prog.natives, prog.rom};
+    run<true>(ctx);
+}
+
+auto reset_context(bytecode_context& ctx) -> void
+{
+    join_workers(ctx); // anything raised by workers of an earlier run that panicked is dropped
+    ctx.frames.clear();
+    ctx.frames.reserve(1000);
+    ctx.stack.resize(0);
+    ctx.globals = &ctx.stack.at(0);
+
+    // Arenas are kept alive and handed out again by the next run
+    ctx.arena_free_list.clear();
+    for (const auto& arena : ctx.arenas) {
+        ctx.arena_free_list.push_back(arena->index);
+    }
+}
+
+auto run_program(bytecode_context& ctx) -> void
+{
+    run<false>(ctx);
+}
+
+auto call_function_limited(
+    bytecode_context& ctx,
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::span<std::byte> result,
+    std::size_t max_ops
+)
+    -> bool
+{
+    reset_context(ctx);
+    ctx.op_budget = max_ops;
+    recoverable_faults = true;
+    try {
+        execute_function<false, true>(ctx, function_id, args);
+    } catch (const evaluation_fault&) {
+        ctx.op_budget = 0;
+    } catch (...) {
+        recoverable_faults = false;
+        throw;
+    }
+    recoverable_faults = false;
+    if (ctx.op_budget == 0 || ctx.stack.size() != result.size()) {
+        return false;
+    }
+    ctx.stack.pop_and_save(result.data(), result.size());
+    return true;
+}
+
+auto run_program_debug(bytecode_context& ctx) -> void
+{
+    run<true>(ctx);
+}
+
+auto call_function(
+    bytecode_context& ctx,
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::span<std::byte> result
+)
+    -> void
+{
+    call<false>(ctx, function_id, args, result);
 }
 
 }
\ No newline at end of file
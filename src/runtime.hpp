@@ -1,11 +1,17 @@
 #pragma once
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <vector>
+#include <span>
 #include <string>
+#include <string_view>
 #include <print>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <memory>
+#include <thread>
 #include <unordered_set>
 
 #include "bytecode.hpp"
@@ -14,9 +20,10 @@ namespace anzu {
 
 struct call_frame
 {
-    std::byte* code = nullptr; // start of the current chunk of bytecode
-    std::byte* ip = nullptr; // instruction pointer
+    const std::byte* code = nullptr; // start of the current chunk of bytecode
+    const std::byte* ip = nullptr; // instruction pointer
     std::size_t base_ptr = 0;
+    std::size_t padding = 0; // bytes below base_ptr added to align the frame
 };
 
 class vm_stack
@@ -25,9 +32,12 @@ class vm_stack
     std::size_t d_max_size;
     std::size_t d_current_size;
 
+    [[noreturn]] auto overflow(std::size_t count) const -> void;
+
 public:
     vm_stack(std::size_t size = 1024 * 1024 * 20);
     auto push(const std::byte* src, std::size_t count) -> void;
+    auto push_zero(std::size_t count) -> void;
     auto pop_and_save(std::byte* dst, std::size_t count) -> void;
     auto save(std::byte* dst, std::size_t count) -> void;
     auto size() const -> std::size_t;
@@ -42,6 +52,25 @@ public:
         push(reinterpret_cast<const std::byte*>(&obj), sizeof(T));
     }
 
+    // Versions of push and pop_and_save for the common sizes, the fixed size lets the
+    // memcpy compile down to a single move
+    template <std::size_t N>
+    auto push_fixed(const std::byte* src) -> void
+    {
+        if (d_current_size + N > d_max_size) [[unlikely]] {
+            overflow(N);
+        }
+        std::memcpy(&d_data[d_current_size], src, N);
+        d_current_size += N;
+    }
+
+    template <std::size_t N>
+    auto pop_and_save_fixed(std::byte* dst) -> void
+    {
+        d_current_size -= N;
+        std::memcpy(dst, &d_data[d_current_size], N);
+    }
+
     template <typename T>
     auto pop() -> T
     {
@@ -55,25 +84,103 @@ public:
 
 struct memory_arena
 {
-    std::array<std::byte, 1024 * 1024 * 64> data; // 64MB;
-    std::size_t next = 0;
-    std::size_t index = 0; // position of the arena in the arena vector
+    alignas(16) std::array<std::byte, 1024 * 1024 * 64> data; // 64MB;
+    std::atomic<std::size_t> next = 0; // bumped atomically, since workers may share an arena
+    std::size_t index = 0;             // position of the arena in the arena vector
+};
+
+// A bounded multi-producer multi-consumer queue of fixed size values. Channels are
+// allocated inside of an arena with the ring buffer of cells directly after the header,
+// each cell being a sequence number followed by the value.
+struct vm_channel
+{
+    std::size_t value_size;
+    std::size_t cell_size;
+    std::size_t mask;
+
+    alignas(64) std::atomic<std::size_t> send_pos;
+    alignas(64) std::atomic<std::size_t> recv_pos;
+
+    // Bumped after every completed send and receive, so that workers blocked on a full or
+    // empty channel can sleep until it changes. The other side only wakes them if some are
+    // known to be sleeping.
+    alignas(64) std::atomic<std::uint32_t> sends;
+    std::atomic<std::uint32_t>             sleeping_receivers;
+    alignas(64) std::atomic<std::uint32_t> receives;
+    std::atomic<std::uint32_t>             sleeping_senders;
 };
 
 struct bytecode_context
 {
-    std::vector<bytecode_function> functions;
-    std::string                    rom;
+    std::span<const bytecode_function> functions;
+    std::span<const bytecode_native>   natives;
+    std::string_view                   rom;
 
     std::vector<call_frame> frames = {};
     vm_stack                stack  = {};
 
+    // Points to the bottom of the stack of the main thread. Workers share the globals
+    // of the context that spawned them.
+    std::byte* globals = nullptr;
+
     std::vector<std::unique_ptr<memory_arena>> arenas          = {};
     std::vector<std::size_t>                   arena_free_list = {};
 
+    // The values returned by @args, each laid out like a char const[]. The strings are
+    // owned by the caller and must outlive the run.
+    std::vector<std::span<const char>> args = {};
+
+    // If set, print statements append to this rather than writing to stdout. Workers
+    // always write to stdout.
+    std::string* output = nullptr;
+
+    // Only used when running with a limit on the number of ops, see call_function_limited
+    std::size_t op_budget = 0;
+
+    // The panic raised by each worker, if any, when panics are thrown rather than exiting.
+    // These are rethrown by @join and once the program ends. A deque so that the workers
+    // can hold references to their slot while more are spawned.
+    std::deque<std::exception_ptr> worker_errors = {};
+
+    // Declared last so that workers are joined before the memory they may be
+    // referencing is released.
+    std::vector<std::jthread> workers = {};
 };
 
 auto run_program(const bytecode_program& prog) -> void;
 auto run_program_debug(const bytecode_program& prog) -> void;
 
+// Returns the context to the state it was in before its first run while keeping all
+// of its allocations, so the stack, frames and arenas stay warm for the next run.
+auto reset_context(bytecode_context& ctx) -> void;
+
+// Runs the main function of the program that the context refers to. The context is
+// reset first, so it can be used for any number of runs, but only by one thread at
+// a time.
+auto run_program(bytecode_context& ctx) -> void;
+auto run_program_debug(bytecode_context& ctx) -> void;
+
+// Calls a single function with the given arguments, copying the return value into result.
+// The main function is not run first, so global variables must not be used.
+auto call_function(
+    bytecode_context& ctx,
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::span<std::byte> result
+)
+    -> void;
+
+// As above, but gives up once max_ops ops have been executed, returning false. This is
+// used by the compiler to evaluate functions at compile time, so faults such as division
+// by zero, out of bounds indexing, stack overflow and runtime assertions also return false
+// rather than aborting. Workers are not limited, so the function must not spawn any.
+auto call_function_limited(
+    bytecode_context& ctx,
+    std::size_t function_id,
+    std::span<const std::byte> args,
+    std::span<std::byte> result,
+    std::size_t max_ops
+)
+    -> bool;
+
 }
\ No newline at end of file
@@ -28,6 +28,7 @@ auto to_string(token_type tt) -> std::string_view
         case token_type::bang:                return "!";        
         case token_type::bar_bar:             return "||";       
         case token_type::bar:                 return "|";        
+        case token_type::caret:               return "^";
         case token_type::character:           return "char";    
         case token_type::colon_equal:         return ":=";       
         case token_type::colon:               return ":";        
@@ -36,10 +37,14 @@ auto to_string(token_type tt) -> std::string_view
         case token_type::eof:                 return "eof";
         case token_type::equal_equal:         return "==";       
         case token_type::equal:               return "=";        
+        case token_type::float32:             return "float32";
         case token_type::float64:             return "float64";
         case token_type::greater_equal:       return ">=";       
+        case token_type::greater_greater:     return ">>";
         case token_type::greater:             return ">";
         case token_type::identifier:          return "identifier";
+        case token_type::int8:                return "int8";
+        case token_type::int16:               return "int16";
         case token_type::int32:               return "int32";
         case token_type::int64:               return "int64";
         case token_type::kw_as:               return "as";
@@ -51,10 +56,13 @@ auto to_string(token_type tt) -> std::string_view
         case token_type::kw_const:            return "const";
         case token_type::kw_continue:         return "continue";
         case token_type::kw_else:             return "else";
+        case token_type::kw_f32:              return "f32";
         case token_type::kw_f64:              return "f64";
         case token_type::kw_false:            return "false";
         case token_type::kw_for:              return "for";
         case token_type::kw_function:         return "fn";
+        case token_type::kw_i8:               return "i8";
+        case token_type::kw_i16:              return "i16";
         case token_type::kw_i32:              return "i32";
         case token_type::kw_i64:              return "i64";
         case token_type::kw_if:               return "if";
@@ -69,6 +77,9 @@ auto to_string(token_type tt) -> std::string_view
         case token_type::kw_struct:           return "struct";
         case token_type::kw_true:             return "true";
         case token_type::kw_type:             return "type";
+        case token_type::kw_u8:               return "u8";
+        case token_type::kw_u16:              return "u16";
+        case token_type::kw_u32:              return "u32";
         case token_type::kw_u64:              return "u64";
         case token_type::kw_var:              return "var";
         case token_type::kw_while:            return "while";
@@ -76,6 +87,7 @@ auto to_string(token_type tt) -> std::string_view
         case token_type::left_bracket:        return "[";        
         case token_type::left_paren:          return "(";        
         case token_type::less_equal:          return "<=";       
+        case token_type::less_less:           return "<<";
         case token_type::less:                return "<";        
         case token_type::minus:               return "-";        
         case token_type::percent:             return "%";        
@@ -88,6 +100,9 @@ auto to_string(token_type tt) -> std::string_view
         case token_type::slash:               return "/";        
         case token_type::star:                return "*";       
         case token_type::string:              return "string-literal"; 
+        case token_type::uint8:               return "uint8";
+        case token_type::uint16:              return "uint16";
+        case token_type::uint32:              return "uint32";
         case token_type::uint64:              return "uint64";
         case token_type::tilde:               return "~";
         default: return "::unknown::";
@@ -16,6 +16,7 @@ enum class token_type
     bang,
     bar_bar,
     bar,
+    caret,
     character,
     colon_equal,
     colon,
@@ -24,10 +25,14 @@ enum class token_type
     eof,
     equal_equal,
     equal,
+    float32,
     float64,
     greater_equal,
+    greater_greater,
     greater,
     identifier,
+    int8,
+    int16,
     int32,
     int64,
     kw_as,
@@ -39,10 +44,13 @@ enum class token_type
     kw_const,
     kw_continue,
     kw_else,
+    kw_f32,
     kw_f64,
     kw_false,
     kw_for,
     kw_function,
+    kw_i8,
+    kw_i16,
     kw_i32,
     kw_i64,
     kw_if,
@@ -57,6 +65,9 @@ enum class token_type
     kw_struct,
     kw_true,
     kw_type,
+    kw_u8,
+    kw_u16,
+    kw_u32,
     kw_u64,
     kw_var,
     kw_while,
@@ -64,6 +75,7 @@ enum class token_type
     left_bracket,
     left_paren,
     less_equal,
+    less_less,
     less,
     minus,
     percent,
@@ -76,6 +88,9 @@ enum class token_type
     slash,
     star,
     string,
+    uint8,
+    uint16,
+    uint32,
     uint64,
     tilde,
 };
@@ -3,8 +3,10 @@
 #include <format>
 #include <source_location>
 #include <chrono>
+#include <exception>
 #include <iostream>
 #include <print>
+#include <stdexcept>
 
 namespace anzu {
 
@@ -48,17 +50,26 @@ struct panic_format {
     std::source_location        loc;
 };
 
+// Thrown by panic instead of exiting while throw_panics is set on the current thread. The
+// embedding API sets it so that errors in a program are reported to the host rather than
+// ending the host process.
+struct panic_error : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+inline thread_local bool throw_panics = false;
+
 template <class... Args>
 [[noreturn]] auto panic(
     panic_format<std::type_identity_t<Args>...> fmt,
-    Args&&... args) noexcept -> void
+    Args&&... args) -> void
 {
-    print(
-        "{}:{} panic: {}\n",
-        fmt.loc.file_name(),
-        fmt.loc.line(),
-        std::format(fmt.fmt, std::forward<Args>(args)...)
-    );
+    auto message = std::format(fmt.fmt, std::forward<Args>(args)...);
+    if (throw_panics) {
+        throw panic_error{std::move(message)};
+    }
+    print("{}:{} panic: {}\n", fmt.loc.file_name(), fmt.loc.line(), message);
     std::exit(1);
 }
 
@@ -66,7 +77,7 @@ template <class... Args>
 auto panic_if(
     bool condition,
     panic_format<std::type_identity_t<Args>...> fmt,
-    Args&&... args) noexcept -> void
+    Args&&... args) -> void
 {
     if (condition) {
         panic(fmt, std::forward<Args>(args)...);
@@ -93,6 +104,8 @@ struct scope_timer
     }
 };
 
+// Runs the callable when the scope is left normally. It is skipped when unwinding from a
+// panic, since the callable could panic again while the first is in flight.
 template <typename Callable>
 class scope_exit
 {
@@ -100,10 +113,11 @@ class scope_exit
     scope_exit& operator=(const scope_exit&) = delete;
 
     Callable d_callable;
+    int      d_exceptions = std::uncaught_exceptions();
 
 public:
     scope_exit(const Callable& callable) : d_callable{callable} {}
-    ~scope_exit() { d_callable(); }
+    ~scope_exit() { if (std::uncaught_exceptions() == d_exceptions) d_callable(); }
 };
 
 template <typename... Ts>
@@ -0,0 +1,564 @@
+#include "verifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <ranges>
+#include <span>
+#include <variant>
+#include <vector>
+
+namespace anzu {
+namespace {
+
+// An op decoded from a function, with its narrowed operands widened again
+struct instruction
+{
+    op                           op_code;
+    std::size_t                  pos;
+    std::size_t                  next;
+    std::array<std::uint64_t, 3> operands = {};
+};
+
+// The number of bytes an op pops from and then pushes onto the stack
+struct stack_effect
+{
+    std::size_t pops;
+    std::size_t pushes;
+};
+
+struct program_info
+{
+    // The size of the value each function returns, or nullopt if it never returns
+    std::vector<std::optional<std::size_t>> return_sizes;
+
+    // The size of the arguments each function is called with, if this is known
+    std::vector<std::optional<std::size_t>> args_sizes;
+
+    // Globals live at the bottom of the stack of the main function, so no global can be
+    // past the deepest point that main reaches. Zero if main is not being verified.
+    std::size_t globals_size = 0;
+};
+
+auto decode(const bytecode_function& function) -> std::variant<std::vector<instruction>, std::string>
+{
+    const auto& code = function.code;
+    auto instructions = std::vector<instruction>{};
+    for (std::size_t pos = 0; pos < code.size();) {
+        auto inst = instruction{};
+        std::memcpy(&inst.op_code, &code[pos], sizeof(op));
+        inst.pos = pos;
+        inst.next = pos + sizeof(op) + encoded_operands_size(inst.op_code);
+        if (inst.next > code.size()) {
+            return std::format("op at {} runs past the end of the function", pos);
+        }
+        const auto narrowed = narrowed_operands(inst.op_code);
+        for (std::size_t i = 0; i != narrowed; ++i) {
+            auto value = bytecode_operand{};
+            std::memcpy(&value, &code[pos + sizeof(op) + i * sizeof(value)], sizeof(value));
+            inst.operands[i] = value;
+        }
+        instructions.push_back(inst);
+        pos = inst.next;
+    }
+    return instructions;
+}
+
+// Returns nullopt for ops that are not valid, calls are handled separately since their
+// effect depends on the function being called
+auto get_stack_effect(const instruction& inst) -> std::optional<stack_effect>
+{
+    const auto& operands = inst.operands;
+    switch (inst.op_code) {
+        case op::push_i8:
+        case op::push_u8:
+        case op::push_char:
+        case op::push_bool:
+        case op::push_null:           return stack_effect{0, 1};
+        case op::push_i16:
+        case op::push_u16:            return stack_effect{0, 2};
+        case op::push_i32:
+        case op::push_u32:
+        case op::push_f32:            return stack_effect{0, 4};
+        case op::push_i64:
+        case op::push_u64:
+        case op::push_f64:
+        case op::push_nullptr:
+        case op::push_function_ptr:
+        case op::push_ptr_rom:
+        case op::push_ptr_global:
+        case op::push_ptr_local:      return stack_effect{0, 8};
+        case op::push_string_literal: return stack_effect{0, 16};
+        case op::push_rom:            return stack_effect{0, operands[1]};
+        case op::push_val_global:
+        case op::push_val_local:      return stack_effect{0, operands[1]};
+        case op::push_val_global_1:
+        case op::push_val_local_1:    return stack_effect{0, 1};
+        case op::push_val_global_4:
+        case op::push_val_local_4:    return stack_effect{0, 4};
+        case op::push_val_global_8:
+        case op::push_val_local_8:    return stack_effect{0, 8};
+        case op::push_val_global_16:
+        case op::push_val_local_16:   return stack_effect{0, 16};
+
+        case op::nth_element_ptr:     return stack_effect{16, 8};
+        case op::nth_element_val:     return stack_effect{16, operands[0]};
+        case op::span_ptr_to_len:     return stack_effect{8, 8};
+        case op::push_subspan:        return stack_effect{24, 16};
+
+        case op::arena_new:           return stack_effect{0, 8};
+        case op::arena_delete:        return stack_effect{8, 0};
+        case op::arena_alloc:         return stack_effect{8 + operands[0], 8};
+        case op::arena_alloc_array:   return stack_effect{16 + operands[0], 16};
+        case op::arena_realloc_array: return stack_effect{32 + operands[0], 16};
+        case op::arena_alloc_soa:     return stack_effect{16 + 8 * operands[0], 16 * operands[0]};
+        case op::arena_size:          return stack_effect{8, 8};
+
+        case op::load:                return stack_effect{8, operands[0]};
+        case op::save:                return stack_effect{8 + operands[0], 0};
+        case op::load_1:              return stack_effect{8, 1};
+        case op::load_4:              return stack_effect{8, 4};
+        case op::load_8:              return stack_effect{8, 8};
+        case op::load_16:             return stack_effect{8, 16};
+        case op::save_1:              return stack_effect{9, 0};
+        case op::save_4:              return stack_effect{12, 0};
+        case op::save_8:              return stack_effect{16, 0};
+        case op::save_16:             return stack_effect{24, 0};
+        case op::push:                return stack_effect{0, operands[0]};
+        case op::push_zero:           return stack_effect{0, operands[0]};
+        case op::pop:                 return stack_effect{operands[0], 0};
+        case op::memcpy:              return stack_effect{32, 1};
+        case op::memcmp:              return stack_effect{16, 1};
+        case op::jump:                return stack_effect{0, 0};
+        case op::jump_if_true:
+        case op::jump_if_false:       return stack_effect{1, 0};
+        case op::ret:                 return stack_effect{operands[0], 0};
+        case op::ret_local:           return stack_effect{0, 0};
+        case op::end_program:         return stack_effect{0, 0};
+        case op::assert:              return stack_effect{1, 0};
+
+        case op::read_file:           return stack_effect{24, 16};
+        case op::channel_new:         return stack_effect{16, 8};
+        case op::channel_send:        return stack_effect{8 + operands[0], 1};
+        case op::channel_recv:        return stack_effect{8, operands[0]};
+        case op::join:                return stack_effect{8, 1};
+        case op::push_args:           return stack_effect{0, 16};
+        case op::atomic_load:         return stack_effect{8, 8};
+        case op::atomic_store:        return stack_effect{16, 1};
+        case op::atomic_add:          return stack_effect{16, 8};
+        case op::atomic_cas:          return stack_effect{24, 1};
+        case op::bits_set:
+        case op::bits_clear:          return stack_effect{32, 1};
+        case op::bits_test:           return stack_effect{32, 1};
+        case op::bits_count:          return stack_effect{16, 8};
+        case op::bits_find_next:      return stack_effect{32, 8};
+        case op::bits_and:
+        case op::bits_or:
+        case op::bits_xor:            return stack_effect{32, 1};
+
+        case op::null_to_i64:
+        case op::bool_to_i64:
+        case op::char_to_i64:
+        case op::null_to_u64:
+        case op::bool_to_u64:
+        case op::char_to_u64:
+        case op::i8_to_i64:
+        case op::u8_to_u64:           return stack_effect{1, 8};
+        case op::i16_to_i64:
+        case op::u16_to_u64:          return stack_effect{2, 8};
+        case op::i32_to_i64:
+        case op::i32_to_u64:
+        case op::u32_to_u64:
+        case op::f32_to_f64:          return stack_effect{4, 8};
+        case op::u64_to_i64:
+        case op::f64_to_i64:
+        case op::i64_to_u64:
+        case op::f64_to_u64:          return stack_effect{8, 8};
+        case op::i64_to_i8:
+        case op::u64_to_u8:           return stack_effect{8, 1};
+        case op::i64_to_i16:
+        case op::u64_to_u16:          return stack_effect{8, 2};
+        case op::u64_to_u32:
+        case op::f64_to_f32:
+        case op::i64_to_i32:          return stack_effect{8, 4};
+
+        case op::char_eq:
+        case op::char_ne:
+        case op::bool_eq:
+        case op::bool_ne:             return stack_effect{2, 1};
+        case op::bool_not:            return stack_effect{1, 1};
+
+        case op::i32_add:
+        case op::i32_sub:
+        case op::i32_mul:
+        case op::i32_div:
+        case op::i32_mod:             return stack_effect{8, 4};
+        case op::i32_eq:
+        case op::i32_ne:
+        case op::i32_lt:
+        case op::i32_le:
+        case op::i32_gt:
+        case op::i32_ge:              return stack_effect{8, 1};
+        case op::i32_neg:             return stack_effect{4, 4};
+
+        case op::i64_add:
+        case op::i64_sub:
+        case op::i64_mul:
+        case op::i64_div:
+        case op::i64_mod:
+        case op::u64_add:
+        case op::u64_sub:
+        case op::u64_mul:
+        case op::u64_div:
+        case op::u64_mod:
+        case op::f64_add:
+        case op::f64_sub:
+        case op::f64_mul:
+        case op::f64_div:
+        case op::u64_and:
+        case op::u64_or:
+        case op::u64_xor:
+        case op::u64_shl:
+        case op::u64_shr:
+        case op::i64_shr:
+        case op::u64_rotl:
+        case op::f64_pow:
+        case op::f64_atan2:
+        case op::i64_min:
+        case op::i64_max:
+        case op::u64_min:
+        case op::u64_max:
+        case op::f64_min:
+        case op::f64_max:             return stack_effect{16, 8};
+        case op::i64_eq:
+        case op::i64_ne:
+        case op::i64_lt:
+        case op::i64_le:
+        case op::i64_gt:
+        case op::i64_ge:
+        case op::u64_eq:
+        case op::u64_ne:
+        case op::u64_lt:
+        case op::u64_le:
+        case op::u64_gt:
+        case op::u64_ge:
+        case op::f64_eq:
+        case op::f64_ne:
+        case op::f64_lt:
+        case op::f64_le:
+        case op::f64_gt:
+        case op::f64_ge:              return stack_effect{16, 1};
+
+        case op::i64_add_imm:
+        case op::i64_sub_imm:
+        case op::i64_mul_imm:
+        case op::i64_div_imm:
+        case op::i64_mod_imm:
+        case op::u64_add_imm:
+        case op::u64_sub_imm:
+        case op::u64_mul_imm:
+        case op::u64_div_imm:
+        case op::u64_mod_imm:         return stack_effect{8, 8};
+        case op::i64_eq_imm:
+        case op::i64_ne_imm:
+        case op::i64_lt_imm:
+        case op::i64_le_imm:
+        case op::i64_gt_imm:
+        case op::i64_ge_imm:
+        case op::u64_eq_imm:
+        case op::u64_ne_imm:
+        case op::u64_lt_imm:
+        case op::u64_le_imm:
+        case op::u64_gt_imm:
+        case op::u64_ge_imm:          return stack_effect{8, 1};
+
+        case op::u64_not:
+        case op::u64_popcount:
+        case op::u64_ctz:
+        case op::u64_clz:
+        case op::f64_sqrt:
+        case op::f64_floor:
+        case op::f64_ceil:
+        case op::f64_round:
+        case op::f64_exp:
+        case op::f64_log:
+        case op::f64_sin:
+        case op::f64_cos:
+        case op::f64_tan:
+        case op::i64_abs:
+        case op::f64_abs:
+        case op::i64_neg:
+        case op::f64_neg:             return stack_effect{8, 8};
+
+        case op::print_null:
+        case op::print_bool:
+        case op::print_char:          return stack_effect{1, 0};
+        case op::print_i32:
+        case op::print_f32:           return stack_effect{4, 0};
+        case op::print_i64:
+        case op::print_u64:
+        case op::print_f64:
+        case op::print_ptr:           return stack_effect{8, 0};
+        case op::print_char_span:     return stack_effect{16, 0};
+
+        default:                      return std::nullopt;
+    }
+}
+
+auto is_call(op op_code) -> bool
+{
+    return op_code == op::call_static || op_code == op::call_ptr || op_code == op::call_native || op_code == op::spawn;
+}
+
+auto is_jump(op op_code) -> bool
+{
+    return op_code == op::jump || op_code == op::jump_if_true || op_code == op::jump_if_false;
+}
+
+auto is_local_read(op op_code) -> bool
+{
+    switch (op_code) {
+        case op::push_val_local:
+        case op::push_val_local_1:
+        case op::push_val_local_4:
+        case op::push_val_local_8:
+        case op::push_val_local_16:
+        case op::ret_local:         return true;
+        default:                    return false;
+    }
+}
+
+auto is_global_access(op op_code) -> bool
+{
+    switch (op_code) {
+        case op::push_ptr_global:
+        case op::push_val_global:
+        case op::push_val_global_1:
+        case op::push_val_global_4:
+        case op::push_val_global_8:
+        case op::push_val_global_16: return true;
+        default:                     return false;
+    }
+}
+
+// Checks the operands that refer to things outside of the function
+auto verify_operands(const bytecode_program& prog, const instruction& inst) -> std::optional<std::string>
+{
+    const auto& operands = inst.operands;
+    const auto check_rom = [&](std::uint64_t index, std::uint64_t size) -> std::optional<std::string> {
+        if (index > prog.rom.size() || size > prog.rom.size() - index) {
+            return std::format("op at {} reads outside of the rom", inst.pos);
+        }
+        return std::nullopt;
+    };
+
+    switch (inst.op_code) {
+        case op::push_string_literal:
+        case op::push_rom:
+        case op::assert:
+            return check_rom(operands[0], operands[1]);
+        case op::push_ptr_rom:
+            return check_rom(operands[0], 0);
+        case op::call_static:
+        case op::push_function_ptr:
+        case op::spawn:
+            if (operands[0] >= prog.functions.size()) {
+                return std::format("op at {} refers to function {} which does not exist", inst.pos, operands[0]);
+            }
+            return std::nullopt;
+        case op::call_native:
+            if (operands[0] >= prog.natives.size()) {
+                return std::format("op at {} refers to native {} which does not exist", inst.pos, operands[0]);
+            }
+            return std::nullopt;
+        default:
+            return std::nullopt;
+    }
+}
+
+// Also records the deepest the stack gets within the function in max_depth
+auto verify_function(
+    const bytecode_program& prog,
+    const program_info& info,
+    const bytecode_function& function,
+    const std::vector<instruction>& instructions,
+    std::size_t& max_depth
+)
+    -> std::optional<std::string>
+{
+    if (instructions.empty()) {
+        return "function has no code";
+    }
+
+    auto index_of = std::vector<std::size_t>(function.code.size() + 1, instructions.size());
+    for (std::size_t i = 0; i != instructions.size(); ++i) {
+        index_of[instructions[i].pos] = i;
+    }
+
+    for (const auto& inst : instructions) {
+        if (!is_call(inst.op_code) && !get_stack_effect(inst)) {
+            return std::format("invalid op code {} at {}", static_cast<int>(inst.op_code), inst.pos);
+        }
+        if (is_jump(inst.op_code) && index_of[std::min(inst.operands[0], function.code.size())] == instructions.size()) {
+            return std::format("op at {} jumps to {} which is not the start of an op", inst.pos, inst.operands[0]);
+        }
+        if (const auto error = verify_operands(prog, inst)) {
+            return error;
+        }
+    }
+
+    // Walk every path through the function, recording the stack depth on entry to each
+    // op. The depth is relative to the top of the arguments, so it starts at zero.
+    const auto args_size = info.args_sizes[function.id];
+    auto depths = std::vector<std::optional<std::size_t>>(instructions.size());
+    auto worklist = std::vector<std::size_t>{0};
+    depths[0] = 0;
+    while (!worklist.empty()) {
+        const auto index = worklist.back();
+        worklist.pop_back();
+        const auto& inst = instructions[index];
+        const auto depth = *depths[index];
+
+        auto effect = stack_effect{};
+        auto returns = true;
+        switch (inst.op_code) {
+            case op::call_static: {
+                const auto ret = info.return_sizes[inst.operands[0]];
+                effect = {inst.operands[1], ret.value_or(0)};
+                returns = ret.has_value();
+            } break;
+            case op::call_ptr:    { effect = {8 + inst.operands[0], inst.operands[1]}; } break;
+            case op::call_native: { effect = {inst.operands[1], inst.operands[2]}; } break;
+            case op::spawn:       { effect = {inst.operands[1], 8}; } break;
+            default:              { effect = *get_stack_effect(inst); } break;
+        }
+
+        if (effect.pops > depth) {
+            return std::format("op at {} pops {} bytes but the stack only has {}", inst.pos, effect.pops, depth);
+        }
+        const auto read_size = inst.op_code == op::ret_local ? inst.operands[1] : effect.pushes;
+        if (is_local_read(inst.op_code) && args_size && inst.operands[0] + read_size > *args_size + depth) {
+            return std::format("op at {} reads past the top of the stack", inst.pos);
+        }
+        // In main, globals are read relative to the bottom of its own stack
+        const auto globals_size = function.id == 0 ? depth : info.globals_size;
+        const auto global_size = inst.op_code == op::push_ptr_global ? 0 : effect.pushes;
+        if (is_global_access(inst.op_code) && inst.operands[0] + global_size > globals_size) {
+            return std::format("op at {} accesses globals past {} bytes", inst.pos, globals_size);
+        }
+        if (inst.op_code == op::end_program && depth != 0) {
+            return std::format("program ends with {} bytes left on the stack", depth);
+        }
+
+        const auto new_depth = depth - effect.pops + effect.pushes;
+        max_depth = std::max(max_depth, new_depth);
+        auto successors = std::array<std::size_t, 2>{};
+        auto num_successors = std::size_t{0};
+        if (is_jump(inst.op_code)) {
+            successors[num_successors++] = index_of[inst.operands[0]];
+        }
+        const auto ends = inst.op_code == op::jump || inst.op_code == op::ret || inst.op_code == op::ret_local
+                       || inst.op_code == op::end_program;
+        if (!ends && returns) {
+            if (index + 1 == instructions.size()) {
+                return std::format("op at {} runs off the end of the function", inst.pos);
+            }
+            successors[num_successors++] = index + 1;
+        }
+
+        for (const auto successor : std::span{successors.data(), num_successors}) {
+            if (!depths[successor]) {
+                depths[successor] = new_depth;
+                worklist.push_back(successor);
+            } else if (*depths[successor] != new_depth) {
+                return std::format("op at {} is reached with stack depths {} and {}",
+                                   instructions[successor].pos, *depths[successor], new_depth);
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+// Verifies the functions with the given ids. Any function they call must also be in the
+// set, and main, if present, must come first since its stack depth bounds the globals.
+auto verify_functions(const bytecode_program& prog, std::span<const std::size_t> ids) -> std::optional<std::string>
+{
+    auto decoded = std::vector<std::vector<instruction>>(prog.functions.size());
+    auto in_set = std::vector<bool>(prog.functions.size());
+    for (const auto id : ids) {
+        const auto& function = prog.functions[id];
+        if (function.id != id) {
+            return std::format("function '{}' has id {} but is at index {}", function.name, function.id, id);
+        }
+        auto result = decode(function);
+        if (auto error = std::get_if<std::string>(&result)) {
+            return std::format("function '{}': {}", function.name, *error);
+        }
+        decoded[id] = std::move(std::get<std::vector<instruction>>(result));
+        in_set[id] = true;
+    }
+
+    // Every ret in a function must return the size it is declared to return, and every
+    // call site must agree on the size of the arguments. Functions folded together may be
+    // called with different argument sizes, in which case the size is treated as unknown.
+    auto info = program_info{
+        .return_sizes = std::vector<std::optional<std::size_t>>(prog.functions.size()),
+        .args_sizes = std::vector<std::optional<std::size_t>>(prog.functions.size())
+    };
+    auto conflicting_args = std::vector<bool>(prog.functions.size());
+    info.args_sizes[0] = 0;
+    for (const auto id : ids) {
+        const auto& function = prog.functions[id];
+        for (const auto& inst : decoded[id]) {
+            if (inst.op_code == op::ret || inst.op_code == op::ret_local) {
+                const auto returned = inst.op_code == op::ret ? inst.operands[0] : inst.operands[1];
+                if (returned != function.return_size) {
+                    return std::format("function '{}' returns {} bytes but is declared to return {}", function.name, returned, function.return_size);
+                }
+                info.return_sizes[id] = returned;
+            }
+            if (inst.op_code == op::call_static || inst.op_code == op::spawn) {
+                if (inst.operands[0] >= prog.functions.size() || !in_set[inst.operands[0]]) {
+                    return std::format("function '{}': op at {} calls function {} which is not being verified", function.name, inst.pos, inst.operands[0]);
+                }
+                auto& size = info.args_sizes[inst.operands[0]];
+                if (size && *size != inst.operands[1]) conflicting_args[inst.operands[0]] = true;
+                size = inst.operands[1];
+            }
+        }
+    }
+    for (std::size_t id = 0; id != prog.functions.size(); ++id) {
+        if (conflicting_args[id]) info.args_sizes[id] = std::nullopt;
+    }
+
+    for (const auto id : ids) {
+        auto max_depth = std::size_t{0};
+        if (const auto error = verify_function(prog, info, prog.functions[id], decoded[id], max_depth)) {
+            return std::format("function '{}': {}", prog.functions[id].name, *error);
+        }
+        if (id == 0) info.globals_size = max_depth;
+    }
+    return std::nullopt;
+}
+
+}
+
+auto verify_program(const bytecode_program& prog) -> std::optional<std::string>
+{
+    if (prog.functions.empty()) {
+        return "program has no functions";
+    }
+    const auto ids = std::views::iota(std::size_t{0}, prog.functions.size()) | std::ranges::to<std::vector>();
+    return verify_functions(prog, ids);
+}
+
+auto verify_subset(const bytecode_program& prog, std::span<const std::size_t> ids) -> std::optional<std::string>
+{
+    if (std::ranges::find(ids, std::size_t{0}) != ids.end()) {
+        return "the main function cannot be verified on its own";
+    }
+    return verify_functions(prog, ids);
+}
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "bytecode.hpp"
+
+#include <optional>
+#include <span>
+#include <string>
+
+namespace anzu {
+
+// Checks that every op code is valid, that operands are in bounds, that jumps land on
+// the start of an op and that each op is always reached with the same stack depth and
+// never pops more than its function has pushed. The runtime does not repeat these
+// checks, so any program not produced by the compiler must be verified before it is run.
+// Returns a description of the first problem found.
+auto verify_program(const bytecode_program& prog) -> std::optional<std::string>;
+
+// As above, but only checks the functions with the given ids, for running part of a program
+// that is still being compiled. Every function they call must be in the set, and globals
+// cannot be accessed since main is excluded.
+auto verify_subset(const bytecode_program& prog, std::span<const std::size_t> ids) -> std::optional<std::string>;
+
+}